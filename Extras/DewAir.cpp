@@ -4,15 +4,18 @@
 #include <iomanip>
 #include <regex>
 #include <ctime>
+#include <vector>
 #include "Logging.h"
 #include "ModbusClientTCP.h"
 #include "parseTarget.h"
+#include "RegisterMap.h"
 
 using std::cout;
 using std::endl;
 using std::printf;
 using std::hex;
 using std::dec;
+using std::vector;
 
 // DewAir data dump
 struct DAdata {
@@ -61,15 +64,26 @@ struct History {
   uint16_t on;
 };
 
+// History tier entry
+struct TierEntry {
+  uint32_t stamp;
+  uint16_t count;
+  uint8_t on;
+  uint16_t avg[4];
+  uint16_t low[4];
+  uint16_t high[4];
+};
+const char *tierNames[] = { "SLOTS", "HOURS", "DAYS" };
+
 // Commands understood
 const char *cmds[] = { 
   "INFO", "ON", "OFF", "EVERY", "EVENTS", "INTERVAL", "HYSTERESIS", 
   "TARGET", "SENSOR", "CONDITION", "FALLBACK", "REBOOT", "ERRORS",
-  "HISTORY",
+  "HISTORY", "COMMIT", "LIVE", "SLOTS",
   "_X_END" };
 enum CMDS : uint8_t { 
   INFO = 0, SW_ON, SW_OFF, EVRY, EVNTS, INTVL, HYST, 
-  TRGT, SNSR, COND, FALLB, REBT, ERRS, HIST,
+  TRGT, SNSR, COND, FALLB, REBT, ERRS, HIST, CMMT, LIVE, SLTS,
   X_END };
 
 const char * typeNam[] = { "temperature", "humidity", "dew point", "reserved"};
@@ -95,18 +109,21 @@ void usage(const char *msg) {
   cout << "  EVERY <seconds>" << endl;
   cout << "  EVENTS" << endl;
   cout << "  ERRORS" << endl;
-  cout << "  HISTORY" << endl;
+  cout << "  HISTORY [SLOTS|HOURS|DAYS]" << endl;
   cout << "  INTERVAL <seconds>" << endl;
   cout << "  HYSTERESIS <steps>" << endl;
   cout << "  TARGET NONE|LOCAL|<host[:port[:serverID]]]>" << endl;
   cout << "  SENSOR <0|1> NONE|LOCAL|<<host[:port[:serverID]]]> <0|1>>" << endl;
   cout << "  CONDITION <SENSOR <0|1>>|DIFF TEMP|HUM|DEW IGNORE|<BELOW|ABOVE <value>>" << endl;
   cout << "  REBOOT" << endl;
+  cout << "  COMMIT" << endl;
+  cout << "  LIVE" << endl;
+  cout << "  SLOTS <count>" << endl;
 }
 
 void printCond(const char *label, uint16_t cond, const char *label2) {
-  uint8_t type = (cond >> 14) & 0x03;
-  float val = int((cond & 0x0FFF) - 2048) / 10.0;
+  uint8_t type = conditionType(cond);
+  float val = conditionValue(cond);
   char buf[20];
 
   if (type) {
@@ -125,16 +142,94 @@ void printCond(const char *label, uint16_t cond, const char *label2) {
   }
 }
 
-int writeSingleRegister(ModbusClient& MBclient, uint8_t targetServer, uint16_t addr, uint16_t iVal, uint16_t minVal, uint16_t maxVal, const char *label) {
+// Register values as read from the device, indexed by register number
+uint16_t regs[REG_EVENTS];
+
+// readRegisters: read a block of registers into regs[]
+Error readRegisters(ModbusClient& MBclient, uint32_t token, uint8_t targetServer, uint16_t addr, uint16_t words) {
+  ModbusMessage response = MBclient.syncRequest(token, targetServer, READ_HOLD_REGISTER, addr, words);
+  Error err = response.getError();
+  if (err == SUCCESS) {
+    uint16_t offs = 3;
+    for (uint16_t i = 0; i < words; i++) {
+      offs = response.get(offs, regs[addr + i]);
+    }
+  }
+  return err;
+}
+
+// regFloat: get a float value from two registers in regs[]
+float regFloat(uint16_t addr) {
+  uint32_t bits = ((uint32_t)regs[addr] << 16) | regs[addr + 1];
+  float f;
+  memcpy(&f, &bits, sizeof(f));
+  return f;
+}
+
+// decodeRegisters: sort the registers 1..lastAddress from regs[] into the DAdata struct
+void decodeRegisters(uint16_t lastAddress) {
+  for (const RegDescriptor& r : REGISTERS) {
+    // Stop at the first register not completely read
+    if (r.address + r.width - 1 > lastAddress) break;
+    // Index 0 and 1 are the sensors, 2 the target or the combined conditions
+    bool isSensor = (r.index < 2);
+    auto& s = d.sensor[r.index & 1];
+    uint16_t v = regs[r.address];
+    switch (r.field) {
+    case RF_MASTER:       d.masterSwitch = v; break;
+    case RF_VALUE_TEMP:   s.temp = regFloat(r.address); break;
+    case RF_VALUE_HUM:    s.hum = regFloat(r.address); break;
+    case RF_VALUE_DEW:    s.dew = regFloat(r.address); break;
+    case RF_SWITCHED:     d.state = v; break;
+    case RF_RESTARTS:     d.restarts = v; break;
+    case RF_RUNTIME:      d.runTime = v; break;
+    case RF_HEALTH:       (isSensor ? s.health : d.tHealth) = v; break;
+    case RF_INTERVAL:     d.interval = v; break;
+    case RF_HYSTERESIS:   d.steps = v; break;
+    case RF_TYPE:         (isSensor ? s.type : d.targetType) = v; break;
+    case RF_IP:
+      {
+        IPAddress& ip = isSensor ? s.ip : d.targetIP;
+        uint8_t offs = (r.encoding == RE_IP_HI) ? 0 : 2;
+        ip[offs] = (v >> 8) & 0xFF;
+        ip[offs + 1] = v & 0xFF;
+      }
+      break;
+    case RF_PORT:         (isSensor ? s.port : d.targetPort) = v; break;
+    case RF_SID:
+      if (isSensor) {
+        s.SID = (v >> 8) & 0xFF;
+        s.slot = v & 0xFF;
+      } else {
+        d.targetSID = (v >> 8) & 0xFF;
+      }
+      break;
+    case RF_COND_TEMP:    (isSensor ? s.tCond : d.cTCond) = v; break;
+    case RF_COND_HUM:     (isSensor ? s.hCond : d.cHCond) = v; break;
+    case RF_COND_DEW:     (isSensor ? s.dCond : d.cDCond) = v; break;
+    case RF_CSTATE:       d.cState = v; break;
+    case RF_FALLBACK:     d.fallbackSwitch = v; break;
+    case RF_HIST_SLOTS:   d.hSlots = v; break;
+    case RF_HIST_ADDRESS: d.hAddress = v; break;
+    case RF_HIST_CURRENT: d.hCurrent = v; break;
+    case RF_EVENT_SLOTS:  d.eSlots = v; break;
+    default: break;
+    }
+  }
+}
+
+// writeSingleRegister: check a value against the register map limits and write it
+int writeSingleRegister(ModbusClient& MBclient, uint8_t targetServer, RegField field, uint8_t index, uint16_t iVal, const char *label) {
   char buf[80];
+  const RegDescriptor *r = findRegister(regAddress(field, index));
 
-//interval must be within limits
-  if (iVal < minVal || iVal > maxVal) {
-    snprintf(buf, 80, "%s requires a value [%d .. %d]", label, minVal, maxVal);
+//value must be within limits
+  if (iVal < r->minVal || iVal > r->maxVal) {
+    snprintf(buf, 80, "%s requires a value [%d .. %d]", label, r->minVal, r->maxVal);
     usage(buf);
     return -1;
   }
-  ModbusMessage response = MBclient.syncRequest(33, targetServer, WRITE_HOLD_REGISTER, addr, iVal);
+  ModbusMessage response = MBclient.syncRequest(33, targetServer, WRITE_HOLD_REGISTER, r->address, iVal);
   Error err = response.getError();
   if (err!=SUCCESS) {
     handleError(err, 33);
@@ -146,6 +241,134 @@ int writeSingleRegister(ModbusClient& MBclient, uint8_t targetServer, uint16_t a
 }
   
 // ============= main =============
+// readHistoryFrames: read all history slots with FC45 frames, following the continuations
+Error readHistoryFrames(ModbusClient& MBclient, uint8_t targetServer, vector<History>& h, uint16_t& hSlots, uint16_t& hCurrent) {
+  uint16_t first = 0;
+  uint32_t token = 40;
+
+  while (first != HF_END) {
+    ModbusMessage request;
+    request.add(targetServer, USER_DEFINED_45, HF_VERSION, first, HF_ALL);
+    ModbusMessage response = MBclient.syncRequest(request, token++);
+    Error err = response.getError();
+    if (err!=SUCCESS) {
+      return err;
+    }
+    // Get the frame header
+    uint8_t version = 0;
+    uint8_t entries = 0;
+    uint16_t start = 0;
+    uint16_t next = HF_END;
+    uint16_t offs = response.get(2, version, hSlots, hCurrent, start, entries, next);
+    // Does it fit to our request?
+    if (version != HF_VERSION || start != first || !entries || start + entries > hSlots
+     || response.size() != offs + entries * HF_ENTRY || (next != HF_END && next != start + entries)) {
+      // No.
+      return PACKET_LENGTH_ERROR;
+    }
+    h.resize(hSlots);
+    for (uint16_t i = start; i < start + entries; i++) {
+      uint8_t on = 0;
+      offs = response.get(offs, h[i].t0, h[i].h0, h[i].t1, h[i].h1, on);
+      h[i].on = on;
+    }
+    first = next;
+  }
+  return SUCCESS;
+}
+
+// readTierFrames: read all entries of a history tier with FC45 version 2 frames
+Error readTierFrames(ModbusClient& MBclient, uint8_t targetServer, uint8_t tier, vector<TierEntry>& h, uint16_t& hSize, uint16_t& hCurrent) {
+  uint16_t first = 0;
+  uint32_t token = 50;
+
+  while (first != HF_END) {
+    ModbusMessage request;
+    request.add(targetServer, USER_DEFINED_45, HF_TIERS, tier, first, HF_ALL);
+    ModbusMessage response = MBclient.syncRequest(request, token++);
+    Error err = response.getError();
+    if (err!=SUCCESS) {
+      return err;
+    }
+    // Get the frame header
+    uint8_t version = 0;
+    uint8_t rTier = HT_END;
+    uint8_t entries = 0;
+    uint16_t start = 0;
+    uint16_t next = HF_END;
+    uint16_t offs = response.get(2, version, rTier, hSize, hCurrent, start, entries, next);
+    // Does it fit to our request?
+    if (version != HF_TIERS || rTier != tier || start != first || !entries || start + entries > hSize
+     || response.size() != offs + entries * HF_TIERENTRY || (next != HF_END && next != start + entries)) {
+      // No.
+      return PACKET_LENGTH_ERROR;
+    }
+    h.resize(hSize);
+    for (uint16_t i = start; i < start + entries; i++) {
+      offs = response.get(offs, h[i].stamp, h[i].count, h[i].on);
+      for (uint8_t v = 0; v < 4; v++) offs = response.get(offs, h[i].avg[v]);
+      for (uint8_t v = 0; v < 4; v++) offs = response.get(offs, h[i].low[v]);
+      for (uint8_t v = 0; v < 4; v++) offs = response.get(offs, h[i].high[v]);
+    }
+    first = next;
+  }
+  return SUCCESS;
+}
+
+// readHistoryRegisters: read all history slots from the history registers (FC03)
+Error readHistoryRegisters(ModbusClient& MBclient, uint8_t targetServer, vector<History>& h, uint16_t& hSlots, uint16_t& hCurrent) {
+//  Get relevant parameters first
+  uint16_t addr = regAddress(RF_HIST_SLOTS);
+  uint16_t words = 3;
+  uint16_t offs = 3;
+  ModbusMessage response = MBclient.syncRequest(27, targetServer, READ_HOLD_REGISTER, addr, words);
+  Error err = response.getError();
+  if (err!=SUCCESS) {
+    return err;
+  }
+  // Got parameters. Allocate memory
+  uint16_t hAddress;
+  offs = response.get(offs, hSlots, hAddress, hCurrent);
+  h.resize(hSlots);
+  // Read data in blocks, each in requests of up to 125 registers
+  addr = hAddress;
+  for (uint8_t block = 0; block < 5; block++) {
+    for (uint16_t first = 0; first < hSlots; first += words) {
+      words = (hSlots - first > 125) ? 125 : hSlots - first;
+      response = MBclient.syncRequest(28 + block, targetServer, READ_HOLD_REGISTER, (uint16_t)(addr + first), words);
+      err = response.getError();
+      if (err!=SUCCESS) {
+        return err;
+      }
+      // Got data. Sort it into the right box
+      offs = 3;
+      for (uint16_t i = first; i < first + words; i++) {
+        switch (block) {
+        case 0: // sensor 0 temp
+          offs = response.get(offs, h[i].t0);
+          break;
+        case 1: // sensor 0 hum
+          offs = response.get(offs, h[i].h0);
+          break;
+        case 2: // sensor 1 temp
+          offs = response.get(offs, h[i].t1);
+          break;
+        case 3: // sensor 1 hum
+          offs = response.get(offs, h[i].h1);
+          break;
+        case 4: // ON percentage
+          offs = response.get(offs, h[i].on);
+          break;
+        default: // cannot happen...
+          break;
+        }
+      }
+    }
+    addr += hSlots;
+  }
+  return SUCCESS;
+}
+
 int main(int argc, char **argv) {
   // Target host parameters
   IPAddress targetIP = NIL_ADDR;
@@ -210,64 +433,11 @@ int main(int argc, char **argv) {
   case INFO:
     {
 //    Read data as one block
-      uint16_t addr = 1;
-      uint16_t words = 64;
-      uint16_t offs = 3;
-      ModbusMessage response = MBclient.syncRequest(1, targetServer, READ_HOLD_REGISTER, addr, words);
-      Error err = response.getError();
+      Error err = readRegisters(MBclient, 1, targetServer, 1, REG_EVENTS - 1);
       if (err!=SUCCESS) {
         handleError(err, 1);
       } else {
-        uint16_t temp;
-        offs = response.get(offs, d.masterSwitch);
-        offs = response.get(offs, d.sensor[0].temp);
-        offs = response.get(offs, d.sensor[0].hum);
-        offs = response.get(offs, d.sensor[0].dew);
-        offs = response.get(offs, d.sensor[1].temp);
-        offs = response.get(offs, d.sensor[1].hum);
-        offs = response.get(offs, d.sensor[1].dew);
-        offs = response.get(offs, d.state);
-        offs = response.get(offs, d.restarts);
-        offs = response.get(offs, d.runTime);
-        offs = response.get(offs, d.sensor[0].health);
-        offs = response.get(offs, d.sensor[1].health);
-        offs = response.get(offs, d.tHealth);
-        offs = response.get(offs, d.interval);
-        offs = response.get(offs, d.steps);
-        for (uint8_t i = 0; i < 2; i++) {
-          offs = response.get(offs, d.sensor[i].type);
-          for (uint8_t j = 0; j < 4; j++) {
-            uint8_t b;
-            offs = response.get(offs, b);
-            d.sensor[i].ip[j] = b;
-          }
-          offs = response.get(offs, d.sensor[i].port);
-          offs = response.get(offs, temp);
-          d.sensor[i].SID = (temp >> 8) & 0xFF;
-          d.sensor[i].slot = temp & 0xFF;
-          offs = response.get(offs, d.sensor[i].tCond);
-          offs = response.get(offs, d.sensor[i].hCond);
-          offs = response.get(offs, d.sensor[i].dCond);
-        }
-        offs = response.get(offs, d.targetType);
-        for (uint8_t j = 0; j < 4; j++) {
-          uint8_t b;
-          offs = response.get(offs, b);
-          d.targetIP[j] = b;
-        }
-        offs = response.get(offs, d.targetPort);
-        offs = response.get(offs, d.targetSID);
-        offs++; // Skip zero byte
-        offs = response.get(offs, d.cTCond);
-        offs = response.get(offs, d.cHCond);
-        offs = response.get(offs, d.cDCond);
-        offs = response.get(offs, d.cState);
-        offs = response.get(offs, d.fallbackSwitch);
-        offs = response.get(offs, d.hSlots);
-        offs = response.get(offs, d.hAddress);
-        offs = response.get(offs, d.hCurrent);
-        offs += 13 * 2; // Skip spare registers
-        offs = response.get(offs, d.eSlots);
+        decodeRegisters(REG_EVENTS - 1);
 
         // Print data
         snprintf(buf, BUFLEN, "Master switch %s", d.masterSwitch ? "ON" : "OFF");
@@ -368,21 +538,13 @@ int main(int argc, char **argv) {
           time_t now = time(NULL);
           struct tm *tm = localtime(&now);
 
-          uint16_t addr = 1;
-          uint16_t words = 14;
-          uint16_t offs = 3;
-          ModbusMessage response = MBclient.syncRequest(21, targetServer, READ_HOLD_REGISTER, addr, words);
-          Error err = response.getError();
+          // Master switch up to the target state
+          const uint16_t words = regAddress(RF_SWITCHED, 2);
+          Error err = readRegisters(MBclient, 21, targetServer, 1, words);
           if (err!=SUCCESS) {
             handleError(err, 1);
           } else {
-            offs = response.get(offs, d.masterSwitch);
-            for (uint8_t i = 0; i < 2; i++) {
-              offs = response.get(offs, d.sensor[i].temp);
-              offs = response.get(offs, d.sensor[i].hum);
-              offs = response.get(offs, d.sensor[i].dew);
-            }
-            offs = response.get(offs, d.state);
+            decodeRegisters(words);
             snprintf(buf, BUFLEN, "%2d:%02d;%.1f;%.1f;%.1f;%.1f;%.1f;%.1f;%.1f;%.1f;%.1f;%d",
               tm->tm_hour,
               tm->tm_min,
@@ -415,15 +577,14 @@ int main(int argc, char **argv) {
 // --------- Switch OFF ------------------
   case SW_OFF:
     {
-//    address 1, value between 0 and 1, name ON/OFF
-      return writeSingleRegister(MBclient, targetServer, 1, masterVal, 0, 1, "ON/OFF");
+      return writeSingleRegister(MBclient, targetServer, RF_MASTER, 0, masterVal, "ON/OFF");
     }
     break;
 // --------- Read event storage -----------------
   case EVNTS:
     {
 //    Read number of event slots
-      uint16_t addr = 64;
+      uint16_t addr = REG_EVENTCOUNT;
       uint16_t words = 1;
       uint16_t offs = 3;
       ModbusMessage response = MBclient.syncRequest(18, targetServer, READ_HOLD_REGISTER, addr, words);
@@ -436,7 +597,7 @@ int main(int argc, char **argv) {
 //      Has it some?
         if (events) {
 //        Yes. Read them.
-          addr = 65;
+          addr = REG_EVENTS;
           offs = 3;
           response = MBclient.syncRequest(19, targetServer, READ_HOLD_REGISTER, addr, events);
           err = response.getError();
@@ -496,8 +657,7 @@ int main(int argc, char **argv) {
       if (argc > 3) {
         iVal = atoi(argv[3]);
       }
-//    address 20, value between 10 and 3600, name INTERVAL
-      return writeSingleRegister(MBclient, targetServer, 20, iVal, 10, 3600, "INTERVAL");
+      return writeSingleRegister(MBclient, targetServer, RF_INTERVAL, 0, iVal, "INTERVAL");
     }
     break;
 // --------- hysteresis steps ------------------
@@ -508,8 +668,23 @@ int main(int argc, char **argv) {
       if (argc > 3) {
         iVal = atoi(argv[3]);
       }
-//    address 21, value between 1 and 16, name HYSTERESIS
-      return writeSingleRegister(MBclient, targetServer, 21, iVal, 1, 16, "HYSTERESIS");
+      return writeSingleRegister(MBclient, targetServer, RF_HYSTERESIS, 0, iVal, "HYSTERESIS");
+    }
+    break;
+// --------- number of history slots ------------------
+  case SLTS:
+    {
+//    Try to get the parameter
+      uint16_t iVal = 0;
+      if (argc > 3) {
+        iVal = atoi(argv[3]);
+      }
+//    Slots must be whole minutes
+      if (iVal && 1440 % iVal) {
+        usage("SLOTS requires a divisor of 1440 (minutes per day)");
+        return -1;
+      }
+      return writeSingleRegister(MBclient, targetServer, RF_HIST_SLOTS, 0, iVal, "SLOTS");
     }
     break;
 // --------- target definition -----------------
@@ -522,12 +697,10 @@ int main(int argc, char **argv) {
       }
 //    Is it NONE?
       if (strncasecmp(argv[3], "NONE", 4) == 0) {
-//      address 38, value 0, name TARGET
-        return writeSingleRegister(MBclient, targetServer, 38, 0, 0, 2, "TARGET:NONE");
+        return writeSingleRegister(MBclient, targetServer, RF_TYPE, 2, 0, "TARGET:NONE");
 //    No, but LOCAL?
       } else if (strncasecmp(argv[3], "LOCAL", 5) == 0) {
-//      address 38, value 1, name TARGET
-        return writeSingleRegister(MBclient, targetServer, 38, 1, 0, 2, "TARGET:LOCAL");
+        return writeSingleRegister(MBclient, targetServer, RF_TYPE, 2, 1, "TARGET:LOCAL");
 //    No, so it must be a Modbus target
       } else {
         IPAddress myIP;
@@ -541,8 +714,9 @@ int main(int argc, char **argv) {
         uint16_t myShiftedSID = (mySID << 8);
 //      Set up request message
         ModbusMessage request;
-//      Header: SID, function code, address, words, bytes
-        request.add(targetServer, WRITE_MULT_REGISTERS, (uint16_t)38, (uint16_t)5, (uint8_t)10);
+//      Header: SID, function code, address, words, bytes - type up to SID
+        const uint16_t words = regAddress(RF_SID, 2) - regAddress(RF_TYPE, 2) + 1;
+        request.add(targetServer, WRITE_MULT_REGISTERS, regAddress(RF_TYPE, 2), words, (uint8_t)(words * 2));
 //      Add target data
         request.add((uint16_t)2);  // type
         for (uint8_t i = 0; i < 4; i++) {
@@ -578,16 +752,12 @@ int main(int argc, char **argv) {
 //    Get type
 //    Is it NONE?
       if (strncasecmp(argv[4], "NONE", 4) == 0) {
-//      address 22, value 0, name SENSOR 0
-//      address 30, value 0, name SENSOR 1
         snprintf(buf, BUFLEN, "SENSOR %d:NONE", sensNum);
-        return writeSingleRegister(MBclient, targetServer, sensNum ? 30 : 22, 0, 0, 2, buf);
+        return writeSingleRegister(MBclient, targetServer, RF_TYPE, sensNum, 0, buf);
 //    No, but LOCAL?
       } else if (strncasecmp(argv[4], "LOCAL", 5) == 0) {
-//      address 22, value 1, name SENSOR 0
-//      address 30, value 1, name SENSOR 1
         snprintf(buf, BUFLEN, "SENSOR %d:LOCAL", sensNum);
-        return writeSingleRegister(MBclient, targetServer, sensNum ? 30 : 22, 1, 0, 2, buf);
+        return writeSingleRegister(MBclient, targetServer, RF_TYPE, sensNum, 1, buf);
 //    No, so it must be a Modbus target
       } else {
 //      We need a slot parameter as well, so check that first
@@ -610,8 +780,9 @@ int main(int argc, char **argv) {
         uint16_t myShiftedSID = (mySID << 8) | slotNum;
 //      Set up request message
         ModbusMessage request;
-//      Header: SID, function code, address, words, bytes
-        request.add(targetServer, WRITE_MULT_REGISTERS, (uint16_t)(sensNum ? 30 : 22), (uint16_t)5, (uint8_t)10);
+//      Header: SID, function code, address, words, bytes - type up to SID and slot
+        const uint16_t words = regAddress(RF_SID, sensNum) - regAddress(RF_TYPE, sensNum) + 1;
+        request.add(targetServer, WRITE_MULT_REGISTERS, regAddress(RF_TYPE, sensNum), words, (uint8_t)(words * 2));
 //      Add target data
         request.add((uint16_t)2);  // type
         for (uint8_t i = 0; i < 4; i++) {
@@ -639,8 +810,7 @@ int main(int argc, char **argv) {
         return -1;
       }
       uint8_t nextArg = 3;
-      uint16_t offset = 43; // Default: first combo condition register
-      uint8_t sensNum = 99;
+      uint8_t sensNum = 99;     // Default: combo conditions
 //    Get reference - sensor or combination
       if (strncasecmp(argv[nextArg], "SENSOR", 6) == 0) {
 //      Seems to be SENSOR. get the number next
@@ -650,7 +820,6 @@ int main(int argc, char **argv) {
           usage("SENSOR number must be 0 or 1");
           return -1;
         }
-        offset = 27 + sensNum * 8;  // first condition register for the chosen sensor
       } else if (strncasecmp(argv[nextArg], "DIFF", 4) == 0) {
 //      Not SENSOR, but DIFF
 //      Nothing to be done here, as it is the default
@@ -704,16 +873,14 @@ int main(int argc, char **argv) {
         }
 //      Check if it is within bounds
         float cVal = atof(argv[nextArg]);
-        uVal = (int(cVal * 10) + 2048) & 0x0FFF;
-        if (abs(float(uVal-2048)/10.0 - cVal) > 0.05) {
+        uVal = encodeCondition(cType, cVal);
+        if (abs(conditionValue(uVal) - cVal) > 0.05) {
           usage("CONDITION values may only be between -204.7 and 204.7");
           return -1;
         }
       }
-//    combine type and value
-      uVal |= (cType << 14);
-//    Adjust offset
-      offset += type;
+//    Find the register for sensor or combination and criterion
+      uint16_t offset = regAddress((RegField)(RF_COND_TEMP + type), sensNum < 2 ? sensNum : 2);
 //    Send request
       ModbusMessage response = MBclient.syncRequest(23, targetServer, WRITE_HOLD_REGISTER, offset, uVal);
       Error err = response.getError();
@@ -750,8 +917,49 @@ int main(int argc, char **argv) {
         usage("FALLBACK needs ON or OFF");
         return -1;
       }
-//    address 47, value 1 or 0, name FALLBACK
-      return writeSingleRegister(MBclient, targetServer, 47, iVal, 0, 1, "FALLBACK");
+      return writeSingleRegister(MBclient, targetServer, RF_FALLBACK, 0, iVal, "FALLBACK");
+    }
+    break;
+// --------- save settings now ------------------
+  case CMMT:
+    {
+      return writeSingleRegister(MBclient, targetServer, RF_COMMIT, 0, 1, "COMMIT");
+    }
+    break;
+// --------- Read the live values from the input registers ------------------
+  case LIVE:
+    {
+//    Function code 04, the complete block
+      ModbusMessage response = MBclient.syncRequest(34, targetServer, READ_INPUT_REGISTER, (uint16_t)IR_SEQUENCE, (uint16_t)(IR_END - IR_SEQUENCE));
+      Error err = response.getError();
+      if (err!=SUCCESS) {
+        handleError(err, 34);
+      } else {
+        uint16_t ir[IR_END];
+        uint16_t offs = 3;
+        for (uint16_t a = IR_SEQUENCE; a < IR_END; a++) {
+          offs = response.get(offs, ir[a]);
+        }
+        snprintf(buf, BUFLEN, "Measurement #%u, run time %d:%02d", ir[IR_SEQUENCE], ir[IR_RUNTIME] / 60, ir[IR_RUNTIME] % 60);
+        cout << buf << endl;
+        for (uint8_t i = 0; i < 2; i++) {
+          uint16_t a = i ? IR_S1_TEMP : IR_S0_TEMP;
+          // Sensor in use?
+          if ((int16_t)ir[a] != IR_INVALID || (int16_t)ir[a + 1] != IR_INVALID) {
+            snprintf(buf, BUFLEN, "Sensor %d: %6.2f°C  %6.2f%%  %6.2f°C  - %04X", 
+              i,
+              fromFixed(ir[a]),
+              fromFixed(ir[a + 1]),
+              fromFixed(ir[a + 2]),
+              ir[i ? IR_S1_HEALTH : IR_S0_HEALTH]);
+            cout << buf << endl;
+          }
+        }
+        snprintf(buf, BUFLEN, "Target is %s - %04X", ir[IR_SWITCHED] ? "ON" : "OFF", ir[IR_TARGET_HEALTH]);
+        cout << buf << endl;
+        snprintf(buf, BUFLEN, "Condition state: %04X", ir[IR_CSTATE]);
+        cout << buf << endl;
+      }
     }
     break;
 // --------- trigger reboot ------------------
@@ -788,7 +996,7 @@ int main(int argc, char **argv) {
   case ERRS:
     {
 //    Read number of event slots to get offset to error tracking data
-      uint16_t addr = 64;
+      uint16_t addr = REG_EVENTCOUNT;
       uint16_t words = 1;
       uint16_t offs = 3;
       ModbusMessage response = MBclient.syncRequest(24, targetServer, READ_HOLD_REGISTER, addr, words);
@@ -835,62 +1043,95 @@ int main(int argc, char **argv) {
           }
         }
       }
+//    Round trip statistics of the remote devices
+      response = MBclient.syncRequest(35, targetServer, READ_HOLD_REGISTER, REG_RTT, (uint16_t)(3 * RR_WORDS));
+      err = response.getError();
+      if (err!=SUCCESS) {
+        cout << "no round trip statistics available." << endl;
+      } else {
+        const char *devNames[] = { "S0", "S1", "target" };
+        cout << "Device  responses timeouts  min ms  avg ms  max ms  p95 ms" << endl;
+        offs = 3;
+        for (uint8_t dev = 0; dev < 3; dev++) {
+          uint16_t w[RR_WORDS];
+          for (uint8_t i = 0; i < RR_WORDS; i++) {
+            offs = response.get(offs, w[i]);
+          }
+          snprintf(buf, BUFLEN, "%-7s %9u %8u %7u %7u %7u %7u", devNames[dev],
+            w[RR_COUNT], w[RR_TIMEOUTS], w[RR_MIN], w[RR_AVG], w[RR_MAX], w[RR_P95]);
+          cout << buf << endl;
+        }
+      }
     }
     break;
 // --------- history data ------------------
   case HIST:
-    {
-//    Get relevant parameters first
-      uint16_t addr = 48;
-      uint16_t words = 3;
-      uint16_t offs = 3;
-      ModbusMessage response = MBclient.syncRequest(27, targetServer, READ_HOLD_REGISTER, addr, words);
-      Error err = response.getError();
-      if (err!=SUCCESS) {
-        handleError(err, 27);
+//  Is a tier wanted?
+    if (argc > 3) {
+      // Yes. Find out which
+      uint8_t tier = HT_END;
+      for (uint8_t t = 0; t < HT_END; t++) {
+        if (strncasecmp(argv[3], tierNames[t], strlen(argv[3])) == 0) {
+          tier = t;
+          break;
+        }
+      }
+      if (tier == HT_END) {
+        usage("HISTORY tier must be one of SLOTS, HOURS or DAYS");
+        return -1;
+      }
+      uint16_t hSize = 0;
+      uint16_t hCurrent = 0;
+      vector<TierEntry> h;
+      Error err = readTierFrames(MBclient, targetServer, tier, h, hSize, hCurrent);
+      if (err == ILLEGAL_DATA_VALUE) {
+        cout << "Device does not know the history tiers." << endl;
+      } else if (err!=SUCCESS) {
+        handleError(err, 50);
       } else {
-        // Got parameters. Check and in case allocate memory
-        uint16_t hSlots, hAddress, hCurrent;
-        offs = response.get(offs, hSlots, hAddress, hCurrent);
-        cout << "slots=" << hSlots << ", address=" << hAddress << ", current=" << hCurrent << endl;
-        History h[hSlots];
-        // Read data in blocks
-        // ***** for now only read up to 126 slots! *****
-        addr = hAddress;
-        words = hSlots;
-        for (uint8_t block = 0; block < 5; block++) {
-          response = MBclient.syncRequest(28 + block, targetServer, READ_HOLD_REGISTER, addr, words);
-          err = response.getError();
-          if (err!=SUCCESS) {
-            handleError(err, 28 + block);
-          } else {
-            // Got data. Sort it into the right box
-            offs = 3;
-            for (uint16_t i = 0; i < hSlots; i++) {
-              switch (block) {
-              case 0: // sensor 0 temp
-                offs = response.get(offs, h[i].t0);
-                break;
-              case 1: // sensor 0 hum
-                offs = response.get(offs, h[i].h0);
-                break;
-              case 2: // sensor 1 temp
-                offs = response.get(offs, h[i].t1);
-                break;
-              case 3: // sensor 1 hum
-                offs = response.get(offs, h[i].h1);
-                break;
-              case 4: // ON percentage
-                offs = response.get(offs, h[i].on);
-                break;
-              default: // cannot happen...
-                break;
-              }
-            }
+        // Ring order: oldest entry behind the current one. Entries beyond the tier's range are leftovers
+        uint32_t newest = 0;
+        for (auto& e : h) {
+          if (e.stamp > newest) newest = e.stamp;
+        }
+        uint32_t range = (tier == HT_DAYS) ? hSize * 86400 : (tier == HT_HOURS) ? hSize * 3600 : 86400;
+        cout << tierNames[tier] << ": entries=" << hSize << ", current=" << hCurrent << endl;
+        cout << "Start;Samples;S0 temp;S0 temp min;S0 temp max;S0 hum;S0 hum min;S0 hum max;"
+             << "S1 temp;S1 temp min;S1 temp max;S1 hum;S1 hum min;S1 hum max;Target ON" << endl;
+        for (uint16_t n = 1; n <= hSize; n++) {
+          TierEntry& e = h[(hCurrent + n) % hSize];
+          if (!e.stamp || e.stamp + range <= newest) continue;
+          time_t t = e.stamp;
+          strftime(buf, BUFLEN, (tier == HT_DAYS) ? "%Y-%m-%d" : "%Y-%m-%d %H:%M", localtime(&t));
+          cout << buf << ";" << e.count;
+          for (uint8_t v = 0; v < 4; v++) {
+            double base = (v & 1) ? 0.0 : 100.0;
+            snprintf(buf, BUFLEN, ";%.1f;%.1f;%.1f",
+              e.avg[v] / 10.0 - base,
+              e.low[v] ? e.low[v] / 10.0 - base : 0.0,
+              e.high[v] ? e.high[v] / 10.0 - base : 0.0);
+            cout << buf;
           }
-          addr += hSlots;
+          cout << ";" << (unsigned)e.on << endl;
         }
+      }
+    } else {
+      uint16_t hSlots = 0;
+      uint16_t hCurrent = 0;
+      vector<History> h;
+//    Try the bulk transfer first
+      Error err = readHistoryFrames(MBclient, targetServer, h, hSlots, hCurrent);
+//    Older firmware will not know it - use the history registers then
+      if (err == ILLEGAL_FUNCTION) {
+        err = readHistoryRegisters(MBclient, targetServer, h, hSlots, hCurrent);
+      }
+      if (err!=SUCCESS) {
+        handleError(err, 40);
+      } else if (!hSlots) {
+        cout << "No history data available." << endl;
+      } else {
         // Got everything now
+        cout << "slots=" << hSlots << ", current=" << hCurrent << endl;
         uint16_t minPerSlot = 1440 / hSlots;
         cout << "Time;S0 temp;S0 hum;S1 temp;S1 hum;Target ON;now" << endl;
         for (uint16_t i = 0; i < hSlots; i++) {
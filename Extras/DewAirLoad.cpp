@@ -0,0 +1,437 @@
+// Copyright 2021 Michael Harwerth - miq1 AT gmx DOT de
+//
+// DewAirLoad: load generator and latency benchmark for the DewAir Modbus server
+// A number of concurrent connections send a mix of register reads and writes as fast as possible.
+// Throughput and latency percentiles are reported per request type.
+// The target may be a DewAir device or a stand-in server started on the loopback interface.
+// The stand-in serves the register map from include/RegisterMap.h like the firmware does: the
+// same address bounds for FC03/FC04/FC10 and the same write checks for FC06/FC10. As on the device,
+// all requests are handled one after the other by a single thread.
+// Build (in the Extras folder):
+//   g++ DewAirLoad.cpp -O2 -std=gnu++17 -Wall -Wextra -I../include -pthread -o DewAirLoad
+// Usage:
+//   DewAirLoad host[:port[:serverID]]|LOCAL [connections [seconds [write percentage [server connections [service us]]]]]
+// Writes will put back the values read before, but will make a device save its settings.
+
+#include <iostream>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <string>
+#include <random>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include <poll.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include "RegisterMap.h"
+
+using std::cout;
+using std::endl;
+using std::vector;
+using std::string;
+using Clock = std::chrono::steady_clock;
+
+// Request types measured
+enum OP : uint8_t { OP_FC03 = 0, OP_FC04, OP_FC06, OP_FC10, OP_END };
+const char *opNames[] = { "FC03 all registers", "FC04 live block", "FC06 single write", "FC10 double write" };
+
+// Modbus exception codes used
+const uint8_t EX_FUNCTION(0x01);
+const uint8_t EX_ADDRESS(0x02);
+const uint8_t EX_VALUE(0x03);
+
+// Parameters (may be changed by the arguments)
+string host("LOCAL");               // Target host, LOCAL for the stand-in server
+uint16_t port(502);                 // Target port
+uint8_t serverID(1);                // Target server ID
+uint16_t CONNECTIONS(4);            // Number of concurrent client connections
+uint16_t SECONDS(10);               // Duration of the measurement
+uint16_t WRITEPERCENT(10);          // Share of write requests
+uint16_t SERVERCONNECTIONS(6);      // Stand-in: connections accepted, as in MBserver.start()
+uint32_t SERVICEUS(0);              // Stand-in: busy time per request in microseconds
+
+// ---------------------- Modbus TCP framing ----------------------
+// recvAll: read exactly len bytes. Returns false on errors, timeouts or a closed connection
+bool recvAll(int fd, uint8_t *buf, size_t len) {
+  while (len) {
+    ssize_t n = recv(fd, buf, len, 0);
+    if (n <= 0) return false;
+    buf += n;
+    len -= n;
+  }
+  return true;
+}
+
+// sendFrame: send a PDU with the MBAP header
+bool sendFrame(int fd, uint16_t tid, uint8_t uid, const uint8_t *pdu, uint16_t len) {
+  uint8_t buf[260];
+  buf[0] = tid >> 8;
+  buf[1] = tid & 0xFF;
+  buf[2] = buf[3] = 0;
+  buf[4] = (len + 1) >> 8;
+  buf[5] = (len + 1) & 0xFF;
+  buf[6] = uid;
+  memcpy(buf + 7, pdu, len);
+  return send(fd, buf, len + 7, MSG_NOSIGNAL) == len + 7;
+}
+
+// recvFrame: get a frame, returning the PDU. Returns false on errors
+bool recvFrame(int fd, uint16_t& tid, uint8_t& uid, uint8_t *pdu, uint16_t& len) {
+  uint8_t head[7];
+  if (!recvAll(fd, head, 7)) return false;
+  tid = (head[0] << 8) | head[1];
+  len = ((head[4] << 8) | head[5]);
+  uid = head[6];
+  if (head[2] || head[3] || len < 2 || len > 254) return false;
+  len--;
+  return recvAll(fd, pdu, len);
+}
+
+inline uint16_t getWord(const uint8_t *cp) { return (cp[0] << 8) | cp[1]; }
+inline void putWord(uint8_t *cp, uint16_t v) { cp[0] = v >> 8; cp[1] = v & 0xFF; }
+
+// ---------------------- stand-in server ----------------------
+uint16_t regs[REG_END];             // Holding registers
+uint16_t inputs[IR_END];            // Input registers
+std::atomic<bool> serverRunning(true);
+
+// exception: set up an exception response
+uint16_t exception(uint8_t *pdu, uint8_t code) {
+  pdu[0] |= 0x80;
+  pdu[1] = code;
+  return 2;
+}
+
+// handleRequest: work on a request PDU, leaving the response in it. Returns the response length
+uint16_t handleRequest(uint8_t *pdu, uint16_t len) {
+  uint16_t address = (len >= 3) ? getWord(pdu + 1) : 0;
+  uint16_t words = (len >= 5) ? getWord(pdu + 3) : 0;
+
+  switch (pdu[0]) {
+  case 0x03:
+    // Same bounds as the firmware's FC03
+    if (len != 5 || !address || !words || words > 125 || address + words > REG_END) return exception(pdu, EX_ADDRESS);
+    pdu[1] = words * 2;
+    for (uint16_t i = 0; i < words; i++) putWord(pdu + 2 + i * 2, regs[address + i]);
+    return 2 + words * 2;
+  case 0x04:
+    if (len != 5 || !address || !words || address + words > IR_END) return exception(pdu, EX_ADDRESS);
+    pdu[1] = words * 2;
+    for (uint16_t i = 0; i < words; i++) putWord(pdu + 2 + i * 2, inputs[address + i]);
+    return 2 + words * 2;
+  case 0x06:
+    if (len != 5) return exception(pdu, EX_VALUE);
+    switch (checkWrite(address, words)) {
+    case RC_ADDRESS: return exception(pdu, EX_ADDRESS);
+    case RC_VALUE:   return exception(pdu, EX_VALUE);
+    default:         regs[address] = words; return 5;
+    }
+  case 0x10:
+    {
+      // Same bounds as the firmware's FC10, all or nothing is written
+      if (!address || !words || address + words > REG_ERRORCOUNT) return exception(pdu, EX_ADDRESS);
+      if (len != 6 + words * 2 || pdu[5] != words * 2) return exception(pdu, EX_VALUE);
+      for (uint16_t i = 0; i < words; i++) {
+        switch (checkWrite(address + i, getWord(pdu + 6 + i * 2))) {
+        case RC_ADDRESS: return exception(pdu, EX_ADDRESS);
+        case RC_VALUE:   return exception(pdu, EX_VALUE);
+        default:         break;
+        }
+      }
+      for (uint16_t i = 0; i < words; i++) regs[address + i] = getWord(pdu + 6 + i * 2);
+      return 5;
+    }
+  default:
+    return exception(pdu, EX_FUNCTION);
+  }
+}
+
+// initRegisters: fill the registers with valid values
+void initRegisters() {
+  for (const RegDescriptor& r : REGISTERS) {
+    for (uint8_t w = 0; w < r.width; w++) {
+      regs[r.address + w] = r.minVal;
+    }
+  }
+  regs[regAddress(RF_SID, 0)] = regs[regAddress(RF_SID, 1)] = regs[regAddress(RF_SID, 2)] = 0x0100;
+  regs[REG_EVENTCOUNT] = MAXEVENT;
+  regs[REG_ERRORCOUNT] = TTslots;
+  for (uint16_t a = IR_SEQUENCE; a < IR_END; a++) {
+    inputs[a] = a * 100;
+  }
+}
+
+// serverLoop: accept connections and serve requests, one at a time
+void serverLoop(int listenFd) {
+  vector<pollfd> fds;
+  fds.push_back({ listenFd, POLLIN, 0 });
+  uint8_t pdu[256];
+
+  while (serverRunning) {
+    if (poll(fds.data(), fds.size(), 100) <= 0) continue;
+    // New connection?
+    if (fds[0].revents & POLLIN) {
+      int fd = accept(listenFd, nullptr, nullptr);
+      if (fd >= 0) {
+        // Refuse it if all connections are taken
+        if (fds.size() > SERVERCONNECTIONS) {
+          close(fd);
+        } else {
+          int one = 1;
+          setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+          fds.push_back({ fd, POLLIN, 0 });
+        }
+      }
+    }
+    // Serve all connections with a request waiting
+    for (size_t i = 1; i < fds.size(); i++) {
+      if (!fds[i].revents) continue;
+      uint16_t tid, len;
+      uint8_t uid;
+      if (!(fds[i].revents & POLLIN) || !recvFrame(fds[i].fd, tid, uid, pdu, len)) {
+        close(fds[i].fd);
+        fds[i].fd = -1;
+        continue;
+      }
+      // Emulate the processing time on the device
+      if (SERVICEUS) {
+        Clock::time_point t0 = Clock::now();
+        while (Clock::now() - t0 < std::chrono::microseconds(SERVICEUS)) { }
+      }
+      len = handleRequest(pdu, len);
+      sendFrame(fds[i].fd, tid, uid, pdu, len);
+    }
+    // Remove closed connections
+    fds.erase(std::remove_if(fds.begin() + 1, fds.end(), [](const pollfd& p) { return p.fd < 0; }), fds.end());
+  }
+  for (size_t i = 1; i < fds.size(); i++) close(fds[i].fd);
+}
+
+// startServer: open the stand-in server on a free loopback port
+int startServer() {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  sockaddr_in sa {};
+  sa.sin_family = AF_INET;
+  sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  sa.sin_port = 0;
+  socklen_t sl = sizeof(sa);
+  if (fd < 0 || bind(fd, (sockaddr *)&sa, sizeof(sa)) || listen(fd, 16) || getsockname(fd, (sockaddr *)&sa, &sl)) {
+    perror("stand-in server");
+    return -1;
+  }
+  port = ntohs(sa.sin_port);
+  host = "127.0.0.1";
+  return fd;
+}
+
+// ---------------------- load generator ----------------------
+// Results of a client connection
+struct ClientResult {
+  vector<float> latency[OP_END];    // Latencies in microseconds per request type
+  uint32_t errors;                  // Exception responses
+  bool failed;                      // Connection lost or refused
+  ClientResult() : errors(0), failed(false) {}
+};
+
+// connectTo: open a connection to the target
+int connectTo() {
+  addrinfo hints {};
+  addrinfo *res = nullptr;
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_STREAM;
+  if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &res)) return -1;
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd >= 0 && connect(fd, res->ai_addr, res->ai_addrlen)) {
+    close(fd);
+    fd = -1;
+  }
+  freeaddrinfo(res);
+  if (fd >= 0) {
+    int one = 1;
+    timeval tv { 2, 0 };
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  }
+  return fd;
+}
+
+// transact: send a request and wait for the response. Returns the response PDU length, 0 on errors
+uint16_t transact(int fd, uint16_t tid, uint8_t *pdu, uint16_t len) {
+  uint16_t rTid;
+  uint8_t rUid;
+  if (!sendFrame(fd, tid, serverID, pdu, len)) return 0;
+  if (!recvFrame(fd, rTid, rUid, pdu, len) || rTid != tid) return 0;
+  return len;
+}
+
+// clientLoop: send requests until the deadline has passed
+void clientLoop(uint16_t id, Clock::time_point deadline, const uint16_t *values, ClientResult& res) {
+  std::mt19937 rnd(id);
+  uint8_t pdu[256];
+  uint16_t tid = 0;
+  const uint16_t aInterval = regAddress(RF_INTERVAL);
+
+  int fd = connectTo();
+  if (fd < 0) {
+    res.failed = true;
+    return;
+  }
+  while (Clock::now() < deadline) {
+    // Choose a request type: writes by the percentage given, the rest split among the reads
+    bool write = (rnd() % 100) < WRITEPERCENT;
+    OP op = write ? ((rnd() & 1) ? OP_FC10 : OP_FC06) : ((rnd() & 1) ? OP_FC04 : OP_FC03);
+    uint16_t len = 5;
+    pdu[0] = op == OP_FC03 ? 0x03 : op == OP_FC04 ? 0x04 : op == OP_FC06 ? 0x06 : 0x10;
+    switch (op) {
+    case OP_FC03: putWord(pdu + 1, 1); putWord(pdu + 3, REG_EVENTS - 1); break;
+    case OP_FC04: putWord(pdu + 1, IR_SEQUENCE); putWord(pdu + 3, IR_END - IR_SEQUENCE); break;
+    // Writes put back the values of interval and hysteresis steps
+    case OP_FC06: putWord(pdu + 1, aInterval + 1); putWord(pdu + 3, values[1]); break;
+    case OP_FC10:
+      putWord(pdu + 1, aInterval);
+      putWord(pdu + 3, 2);
+      pdu[5] = 4;
+      putWord(pdu + 6, values[0]);
+      putWord(pdu + 8, values[1]);
+      len = 10;
+      break;
+    default: break;
+    }
+    Clock::time_point t0 = Clock::now();
+    len = transact(fd, ++tid, pdu, len);
+    float us = std::chrono::duration<float, std::micro>(Clock::now() - t0).count();
+    if (!len) {
+      res.failed = true;
+      break;
+    }
+    if (pdu[0] & 0x80) {
+      res.errors++;
+    } else {
+      res.latency[op].push_back(us);
+    }
+  }
+  close(fd);
+}
+
+// percentile: get the p-th percentile of sorted values
+float percentile(const vector<float>& v, double p) {
+  if (v.empty()) return 0.0;
+  size_t i = (size_t)(p * (v.size() - 1) + 0.5);
+  return v[i];
+}
+
+// printResult: print a line of results
+void printResult(const char *label, vector<float>& v) {
+  char buf[128];
+  std::sort(v.begin(), v.end());
+  snprintf(buf, 128, "%-20s %9zu %10.1f %9.1f %9.1f %9.1f %9.1f", label, v.size(), v.size() / (double)SECONDS,
+    percentile(v, 0.5), percentile(v, 0.99), percentile(v, 0.999), v.empty() ? 0.0 : v.back());
+  cout << buf << endl;
+}
+
+// parseHost: split host[:port[:serverID]]
+bool parseHost(const char *arg) {
+  string a(arg);
+  size_t c1 = a.find(':');
+  host = a.substr(0, c1);
+  if (c1 != string::npos) {
+    size_t c2 = a.find(':', c1 + 1);
+    port = atoi(a.substr(c1 + 1, c2 - c1 - 1).c_str());
+    if (c2 != string::npos) serverID = atoi(a.substr(c2 + 1).c_str());
+  }
+  return !host.empty() && port && serverID && serverID <= 247;
+}
+
+// ============= main =============
+int main(int argc, char **argv) {
+  if (argc < 2 || !parseHost(argv[1])) {
+    cout << "Usage: DewAirLoad host[:port[:serverID]]|LOCAL [connections [seconds [write percentage [server connections [service us]]]]]" << endl;
+    return -1;
+  }
+  if (argc > 2) CONNECTIONS = atoi(argv[2]);
+  if (argc > 3) SECONDS = atoi(argv[3]);
+  if (argc > 4) WRITEPERCENT = atoi(argv[4]);
+  if (argc > 5) SERVERCONNECTIONS = atoi(argv[5]);
+  if (argc > 6) SERVICEUS = atoi(argv[6]);
+  if (!CONNECTIONS || !SECONDS || WRITEPERCENT > 100) {
+    cout << "At least one connection and one second needed, write percentage up to 100." << endl;
+    return -1;
+  }
+
+  // Stand-in server requested?
+  std::thread server;
+  int listenFd = -1;
+  bool local = (strcasecmp(host.c_str(), "LOCAL") == 0);
+  if (local) {
+    // Yes. Start it
+    initRegisters();
+    listenFd = startServer();
+    if (listenFd < 0) return -1;
+    server = std::thread(serverLoop, listenFd);
+    cout << "Stand-in server on port " << port << ", " << SERVERCONNECTIONS << " connections, "
+         << SERVICEUS << "us per request" << endl;
+  }
+
+  // Get the values to write back
+  uint16_t values[2] = { 0, 0 };
+  int fd = connectTo();
+  uint8_t pdu[256] = { 0x03 };
+  putWord(pdu + 1, regAddress(RF_INTERVAL));
+  putWord(pdu + 3, 2);
+  if (fd < 0 || transact(fd, 0, pdu, 5) != 6 || pdu[0] != 0x03) {
+    cout << "Could not read from " << host << ":" << port << ":" << (unsigned)serverID << endl;
+  } else {
+    values[0] = getWord(pdu + 2);
+    values[1] = getWord(pdu + 4);
+  }
+  if (fd >= 0) close(fd);
+  // Give the server some time to notice the closed connection
+  usleep(200000);
+
+  if (values[0]) {
+    // Run the clients
+    cout << CONNECTIONS << " connections, " << SECONDS << "s, " << WRITEPERCENT << "% writes" << endl;
+    vector<ClientResult> results(CONNECTIONS);
+    vector<std::thread> clients;
+    Clock::time_point deadline = Clock::now() + std::chrono::seconds(SECONDS);
+    for (uint16_t i = 0; i < CONNECTIONS; i++) {
+      clients.emplace_back(clientLoop, i, deadline, values, std::ref(results[i]));
+    }
+    for (auto& t : clients) t.join();
+
+    // Collect the results
+    vector<float> ops[OP_END];
+    vector<float> all;
+    uint32_t errors = 0;
+    uint16_t failed = 0;
+    for (auto& r : results) {
+      for (uint8_t o = 0; o < OP_END; o++) {
+        ops[o].insert(ops[o].end(), r.latency[o].begin(), r.latency[o].end());
+        all.insert(all.end(), r.latency[o].begin(), r.latency[o].end());
+      }
+      errors += r.errors;
+      failed += r.failed ? 1 : 0;
+    }
+    cout << "Request               requests   req/s    p50 us    p99 us   p999 us    max us" << endl;
+    for (uint8_t o = 0; o < OP_END; o++) {
+      if (!ops[o].empty()) printResult(opNames[o], ops[o]);
+    }
+    printResult("all", all);
+    cout << errors << " exception responses, " << failed << " connections refused or lost" << endl;
+  }
+
+  if (local) {
+    serverRunning = false;
+    server.join();
+    close(listenFd);
+  }
+  return values[0] ? 0 : 1;
+}
@@ -0,0 +1,275 @@
+// Copyright 2021 Michael Harwerth - miq1 AT gmx DOT de
+//
+// RingBufBench: host-native benchmark and sanity checks for src/RingBuf.h
+// Build (in the Extras folder):
+//   g++ RingBufBench.cpp -O2 -std=gnu++17 -Wall -Wextra -I../src -o RingBufBench
+// Usage:
+//   RingBufBench [operations per measurement]
+
+#include <iostream>
+#include <chrono>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include "RingBuf.h"
+
+using std::cout;
+using std::endl;
+using std::vector;
+using Clock = std::chrono::steady_clock;
+
+// A struct element type, like a timestamped sample record
+struct Sample {
+  uint32_t stamp;
+  uint16_t code;
+  uint16_t value;
+  float data;
+};
+
+// Buffer sizes to be measured
+const size_t sizes[] = { 16, 256, 4096, 65536 };
+// Number of operations per measurement (may be changed by the first argument)
+uint32_t OPS(200000);
+// Number of elements per batch push_back
+const size_t BATCH(32);
+
+// Result of a single measurement
+struct Result {
+  double nsPerOp;                  // Average time per operation in ns
+  double worstNs;                  // Slowest single operation in ns
+};
+
+// nsSince: get nanoseconds passed since t0
+inline double nsSince(Clock::time_point t0) {
+  return std::chrono::duration<double, std::nano>(Clock::now() - t0).count();
+}
+
+// makeValue: generate a test value for element type T from a number
+template <typename T> T makeValue(uint32_t i) { return (T)i; }
+template <> Sample makeValue<Sample>(uint32_t i) { return Sample { i, (uint16_t)(i & 0x1F), (uint16_t)i, i * 0.1f }; }
+
+// Prevent the optimizer from dropping results
+volatile uint32_t sink;
+template <typename T> void consume(const T& v) { sink = sink + *(const uint8_t *)&v; }
+
+// measure: run op() ops times, first in a tight loop for the average, then timed one by one for the worst case
+// prepare() is called before each op() in both runs and is not timed in the worst case run.
+template <typename P, typename O>
+Result measure(P prepare, O op, uint32_t ops = OPS) {
+  Result r;
+  // Average run
+  Clock::time_point t0 = Clock::now();
+  for (uint32_t i = 0; i < ops; ++i) {
+    prepare(i);
+    op(i);
+  }
+  r.nsPerOp = nsSince(t0) / ops;
+  // Worst case run
+  r.worstNs = 0.0;
+  for (uint32_t i = 0; i < ops; ++i) {
+    prepare(i);
+    Clock::time_point t1 = Clock::now();
+    op(i);
+    double t = nsSince(t1);
+    if (t > r.worstNs) r.worstNs = t;
+  }
+  return r;
+}
+
+// printResult: print a line of results
+void printResult(const char *type, size_t size, const char *label, Result r) {
+  char buf[128];
+  snprintf(buf, 128, "%-9s %6zu  %-22s %10.1f %12.1f", type, size, label, r.nsPerOp, r.worstNs);
+  cout << buf << endl;
+}
+
+// bench: run all measurements for element type T and buffer size
+template <typename T>
+void bench(const char *type, size_t size) {
+  RingBuf<T> rb(size);
+  vector<T> src(size > BATCH ? size : BATCH);
+  vector<T> dst(size);
+  // Operations on the complete buffer are run less often for larger buffers
+  uint32_t wholeOps = (uint32_t)std::max((size_t)100, (OPS * 16) / size);
+  for (uint32_t i = 0; i < src.size(); ++i) src[i] = makeValue<T>(i);
+
+  // push_back of single elements to a full, rolling buffer
+  rb.clear();
+  rb.push_back(src.data(), size);
+  printResult(type, size, "push_back (full)", measure(
+    [](uint32_t) { },
+    [&](uint32_t i) { rb.push_back(makeValue<T>(i)); }));
+
+  // push_back of batches of BATCH elements to a full, rolling buffer
+  printResult(type, size, "push_back (batch 32)", measure(
+    [](uint32_t) { },
+    [&](uint32_t) { rb.push_back(src.data(), BATCH); }));
+
+  // pop of a single element. Refill if empty.
+  rb.clear();
+  printResult(type, size, "pop", measure(
+    [&](uint32_t) { if (rb.empty()) rb.push_back(src.data(), size); },
+    [&](uint32_t) { rb.pop(1); }));
+
+  // safeCopy of the complete buffer, without move
+  rb.clear();
+  rb.push_back(src.data(), size);
+  rb.pop(size / 2);
+  rb.push_back(src.data(), size / 2);     // Make the buffer wrap around
+  printResult(type, size, "safeCopy (all)", measure(
+    [](uint32_t) { },
+    [&](uint32_t) { consume(dst[rb.safeCopy(dst.data(), size) - 1]); },
+    wholeOps));
+
+  // safeCopy of 16 elements with move. Refill if empty.
+  printResult(type, size, "safeCopy (16, move)", measure(
+    [&](uint32_t) { if (rb.size() < 16) rb.push_back(src.data(), size - rb.size()); },
+    [&](uint32_t) { consume(dst[rb.safeCopy(dst.data(), 16, true) - 1]); }));
+
+  // iteration over the complete (wrapped) buffer. Per element times reported!
+  rb.clear();
+  rb.push_back(src.data(), size);
+  rb.pop(size / 2);
+  rb.push_back(src.data(), size / 2);
+  Result r = measure(
+    [](uint32_t) { },
+    [&](uint32_t) { uint32_t s = 0; for (auto& v : rb) { s += *(const uint8_t *)&v; } sink = s; },
+    wholeOps);
+  r.nsPerOp /= size;
+  r.worstNs /= size;
+  printResult(type, size, "iterate (per element)", r);
+}
+
+// ---------------------- sanity checks ----------------------
+int failures = 0;
+
+// check: report a failed condition
+void check(bool cond, const char *what) {
+  if (!cond) {
+    cout << "FAILED: " << what << endl;
+    failures++;
+  }
+}
+
+// sameContents: compare a RingBuf against expected values
+template <typename T>
+bool sameContents(RingBuf<T>& rb, const vector<T>& expected) {
+  if (rb.size() != expected.size()) return false;
+  size_t i = 0;
+  for (auto& v : rb) {
+    if (memcmp(&v, &expected[i], sizeof(T))) return false;
+    ++i;
+  }
+  return true;
+}
+
+// checkCopyMove: verify copy and move construction and assignment
+template <typename T>
+void checkCopyMove() {
+  // Prepare a wrapped buffer
+  RingBuf<T> a(10);
+  vector<T> expected;
+  for (uint32_t i = 0; i < 14; ++i) {
+    a.push_back(makeValue<T>(i));
+  }
+  for (uint32_t i = 4; i < 14; ++i) {
+    expected.push_back(makeValue<T>(i));
+  }
+  check(sameContents(a, expected), "wrapped buffer contents");
+
+  // Copy constructor
+  RingBuf<T> b(a);
+  check(b.valid() && sameContents(b, expected), "copy constructor");
+  check(b == a, "operator== after copy");
+  // The copy must be independent
+  b.push_back(makeValue<T>(99));
+  check(sameContents(a, expected), "copy constructor independence");
+
+  // Copy assignment to a smaller buffer keeps the newest elements
+  RingBuf<T> c(4);
+  c = a;
+  check(sameContents(c, vector<T>(expected.end() - 4, expected.end())), "copy assignment to smaller buffer");
+  // Copy assignment to a preserving, smaller buffer will take nothing
+  RingBuf<T> cp(4, true);
+  cp = a;
+  check(cp.empty(), "copy assignment to smaller preserving buffer");
+
+  // Move constructor takes over the data and leaves the source invalid
+  RingBuf<T> d(std::move(b));
+  check(!b.valid(), "move constructor source invalid");
+  check(d.valid() && d.size() == 10, "move constructor");
+
+  // Move assignment
+  RingBuf<T> e(20);
+  e = std::move(d);
+  check(!d.valid(), "move assignment source invalid");
+  expected.erase(expected.begin());
+  expected.push_back(makeValue<T>(99));
+  check(sameContents(e, expected), "move assignment");
+
+  // Fixed size buffers
+  RingBuf<T, 10> f;
+  for (uint32_t i = 0; i < 14; ++i) {
+    f.push_back(makeValue<T>(i));
+  }
+  RingBuf<T, 10> g(f);
+  check(g == f, "fixed size copy constructor");
+  RingBuf<T, 10> h;
+  h = std::move(g);
+  check(h == f && g.empty(), "fixed size move assignment");
+}
+
+// checkAccess: verify emplace_back and the element accessors on a struct buffer
+void checkAccess() {
+  RingBuf<Sample, 4> rb;
+  Sample s;
+  // Accessors on an empty buffer
+  check(rb.at(0) == nullptr && !rb.get(0, s), "accessors on empty buffer");
+  check(rb.last().stamp == 0 && rb[3].code == 0, "value-initialized elements");
+  // Construct 6 records in place - the first two will be rolled out
+  for (uint32_t i = 0; i < 6; ++i) {
+    rb.emplace_back(i, (uint16_t)(i & 0x1F), (uint16_t)(i * 2), i * 0.5f);
+  }
+  check(rb.size() == 4 && rb.at(0) && rb.at(0)->stamp == 2, "emplace_back rolling");
+  check(rb.get(3, s) && s.value == 10 && rb.last().stamp == 5, "get and last");
+  check(rb.at(4) == nullptr && !rb.get(4, s), "accessors out of range");
+  // Copy out a wrapped range
+  Sample out[4];
+  check(rb.copyRange(out, 1, 10) == 3 && out[0].stamp == 3 && out[2].stamp == 5, "copyRange");
+  // A preserving buffer will refuse to emplace
+  RingBuf<Sample> pb(2, true);
+  check(pb.emplace_back(1u, (uint16_t)1, (uint16_t)1, 1.0f) && pb.emplace_back(2u, (uint16_t)2, (uint16_t)2, 2.0f)
+        && !pb.emplace_back(3u, (uint16_t)3, (uint16_t)3, 3.0f), "emplace_back preserving");
+}
+
+// ============= main =============
+int main(int argc, char **argv) {
+  // Number of operations given?
+  if (argc > 1) {
+    // Yes, take it
+    OPS = atoi(argv[1]);
+    if (OPS < 100) {
+      cout << "At least 100 operations needed." << endl;
+      return -1;
+    }
+  }
+
+  // Sanity checks first
+  checkCopyMove<uint8_t>();
+  checkCopyMove<uint16_t>();
+  checkCopyMove<Sample>();
+  checkAccess();
+  if (failures) {
+    cout << failures << " sanity check(s) failed." << endl;
+    return 1;
+  }
+  cout << "Sanity checks passed." << endl;
+
+  // Benchmarks
+  cout << "Type        Size  Operation               ns/op avg  ns/op worst" << endl;
+  for (size_t s : sizes) bench<uint8_t>("uint8_t", s);
+  for (size_t s : sizes) bench<uint16_t>("uint16_t", s);
+  for (size_t s : sizes) bench<Sample>("Sample", s);
+  return 0;
+}
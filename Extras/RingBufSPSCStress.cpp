@@ -0,0 +1,147 @@
+// Copyright 2021 Michael Harwerth - miq1 AT gmx DOT de
+//
+// RingBufSPSCStress: host-native stress test for src/RingBufSPSC.h
+// One producer thread pushes a running sequence number, one consumer thread checks
+// that every value taken is exactly the previous one plus one.
+// Build (in the Extras folder):
+//   g++ RingBufSPSCStress.cpp -O2 -std=gnu++17 -Wall -Wextra -I../src -pthread -o RingBufSPSCStress
+// or with the thread sanitizer:
+//   g++ RingBufSPSCStress.cpp -O1 -g -std=gnu++17 -Wall -Wextra -I../src -pthread -fsanitize=thread -o RingBufSPSCStress
+// Usage:
+//   RingBufSPSCStress [items per run]
+
+#include <iostream>
+#include <thread>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include "RingBufSPSC.h"
+
+using std::cout;
+using std::endl;
+
+// Ways for the consumer to take the elements out
+enum ConsumeMode : uint8_t { CM_POP = 0, CM_PEEK_POPN, CM_SAFECOPY_MOVE, CM_END };
+const char *modeNames[] = { "pop(T&)", "safeCopy+pop(n)", "safeCopy(move)" };
+
+// Batch size for the block wise consumer modes
+const size_t BATCH(7);
+
+// checkFull: single threaded - a full buffer must refuse further elements and keep its contents
+template <size_t N>
+bool checkFull() {
+  RingBufSPSC<uint32_t, N> rb;
+  for (uint32_t i = 0; i < N; i++) {
+    if (!rb.push_back(i)) {
+      printf("N=%zu: push %u refused before the buffer was full\n", N, i);
+      return false;
+    }
+  }
+  if (rb.push_back(N) || rb.size() != N || rb.capacity() != 0) {
+    printf("N=%zu: full buffer accepted an element\n", N);
+    return false;
+  }
+  // Making room must allow exactly one more
+  uint32_t v = 0;
+  if (!rb.pop(v) || v != 0 || !rb.push_back(N) || rb.push_back(N + 1)) {
+    printf("N=%zu: wrong behaviour after pop from a full buffer\n", N);
+    return false;
+  }
+  for (uint32_t i = 1; i <= N; i++) {
+    if (!rb.pop(v) || v != i) {
+      printf("N=%zu: expected %u, got %u\n", N, i, v);
+      return false;
+    }
+  }
+  return rb.empty();
+}
+
+// stress: run producer and consumer threads over items elements
+template <size_t N>
+bool stress(uint32_t items, ConsumeMode mode) {
+  RingBufSPSC<uint32_t, N> rb;
+  std::atomic<uint64_t> refused(0);
+
+  std::thread producer([&]() {
+    uint64_t full = 0;
+    for (uint32_t seq = 0; seq < items; ) {
+      if (rb.push_back(seq)) {
+        seq++;
+      } else {
+        // Full - the consumer has to catch up
+        full++;
+        std::this_thread::yield();
+      }
+    }
+    refused = full;
+  });
+
+  // Consumer: this thread
+  uint32_t expected = 0;
+  uint32_t errors = 0;
+  uint32_t buf[BATCH];
+  while (expected < items && errors < 10) {
+    size_t got = 0;
+    switch (mode) {
+    case CM_POP:
+      got = rb.pop(buf[0]) ? 1 : 0;
+      break;
+    case CM_PEEK_POPN:
+      got = rb.safeCopy(buf, BATCH);
+      if (got && rb.pop(got) != got) {
+        printf("N=%zu: pop(%zu) removed less than copied\n", N, got);
+        errors++;
+      }
+      break;
+    case CM_SAFECOPY_MOVE:
+      got = rb.safeCopy(buf, BATCH, true);
+      break;
+    default:
+      break;
+    }
+    if (!got) {
+      std::this_thread::yield();
+      continue;
+    }
+    for (size_t i = 0; i < got; i++) {
+      if (buf[i] != expected) {
+        printf("N=%zu %s: expected %u, got %u\n", N, modeNames[mode], expected, buf[i]);
+        errors++;
+        expected = buf[i];
+      }
+      expected++;
+    }
+  }
+  producer.join();
+  if (!errors && !rb.empty()) {
+    printf("N=%zu %s: %zu elements left over\n", N, modeNames[mode], rb.size());
+    errors++;
+  }
+  printf("N=%-5zu %-16s %10u items, %10llu pushes refused: %s\n", N, modeNames[mode], items,
+    (unsigned long long)refused.load(), errors ? "FAILED" : "OK");
+  return errors == 0;
+}
+
+// runAll: all consumer modes for one buffer size
+template <size_t N>
+bool runAll(uint32_t items) {
+  bool ok = checkFull<N>();
+  for (uint8_t m = 0; m < CM_END; m++) {
+    ok = stress<N>(items, (ConsumeMode)m) && ok;
+  }
+  return ok;
+}
+
+int main(int argc, char **argv) {
+  uint32_t items = 4000000;
+  if (argc > 1) {
+    items = strtoul(argv[1], nullptr, 10);
+  }
+
+  bool ok = runAll<2>(items);
+  ok = runAll<16>(items) && ok;
+  ok = runAll<1024>(items) && ok;
+
+  cout << (ok ? "All checks passed." : "Checks FAILED.") << endl;
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,279 @@
+// RegisterMap
+// Copyright 2021 by miq1@gmx.de
+//
+// RegisterMap describes the Modbus holding registers of a DewAir device.
+// It is shared by the firmware (src/main.cpp) and the Linux tool (Extras/DewAir.cpp),
+// so both will always agree on the register layout.
+// Registers 1..64 are described one by one in REGISTERS[], the event and error tracking
+// blocks behind are arrays given by their start addresses, followed by the round trip statistics.
+// The live values are available as input registers (FC04) as well, see InputRegister.
+// The history can be fetched in bulk with the user defined function code 0x45, see HF_VERSION.
+#ifndef _REGISTERMAP_H
+#define _REGISTERMAP_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <math.h>
+
+// The register names are only needed on the host side - save the RAM on the device
+#if defined(ESP8266) || defined(ESP32)
+#define REGNAME(x) nullptr
+#else
+#define REGNAME(x) x
+#endif
+
+// Number of event slots
+const uint8_t MAXEVENT(40);
+// Number of error groups tracked
+const uint16_t TTslots(30);
+
+// Register blocks
+const uint16_t REG_EVENTCOUNT(64);                      // Number of event slots
+const uint16_t REG_EVENTS(65);                          // First event register
+const uint16_t REG_ERRORCOUNT(65 + MAXEVENT);           // Number of error tracking slots
+const uint16_t REG_ERRORS(66 + MAXEVENT);               // First error tracking register (code and count pairs)
+const uint16_t REG_RTT(66 + MAXEVENT + TTslots * 2);    // First round trip statistics register
+const uint16_t REG_END(REG_RTT + 3 * 6);                // First register behind the map
+
+// Round trip statistics: a group of registers for each remote device (S0, S1, target)
+enum RttRegister : uint8_t {
+  RR_COUNT = 0,       // Number of responses
+  RR_TIMEOUTS,        // Number of requests without response
+  RR_MIN,             // Shortest round trip time in ms
+  RR_AVG,             // Average round trip time in ms
+  RR_MAX,             // Longest round trip time in ms
+  RR_P95,             // 95th percentile of the recent round trip times in ms
+  RR_WORDS            // Registers per remote device
+};
+static_assert(REG_END == REG_RTT + 3 * RR_WORDS, "Round trip statistics block size mismatch");
+
+// Encoding of a register value
+enum RegEncoding : uint8_t {
+  RE_UINT16 = 0,  // plain value
+  RE_BOOL,        // 0=false, 1=true
+  RE_FLOAT,       // IEEE754 float in two registers, upper word first
+  RE_IP_HI,       // IP address bytes 0 and 1
+  RE_IP_LO,       // IP address bytes 2 and 3
+  RE_SID_SLOT,    // Modbus server ID in the upper byte, sensor slot 0 or 1 in the lower byte
+  RE_SID,         // Modbus server ID in the upper byte, lower byte unused
+  RE_CONDITION,   // condition type in bits 14..15, value * 10 + 2048 in bits 0..11
+};
+
+// Data fields bound to registers.
+// The index of a descriptor selects the sensor (0 or 1) or the target/combination (2)
+enum RegField : uint8_t {
+  RF_MASTER = 0, RF_VALUE_TEMP, RF_VALUE_HUM, RF_VALUE_DEW, RF_SWITCHED,
+  RF_RESTARTS, RF_RUNTIME, RF_HEALTH, RF_INTERVAL, RF_HYSTERESIS,
+  RF_TYPE, RF_IP, RF_PORT, RF_SID, RF_COND_TEMP, RF_COND_HUM, RF_COND_DEW,
+  RF_CSTATE, RF_FALLBACK, RF_HIST_SLOTS, RF_HIST_ADDRESS, RF_HIST_CURRENT, RF_COMMIT, RF_EVENT_SLOTS,
+};
+
+// Source of a register value - registers of the same source change together
+enum RegSource : uint8_t { RS_CONST = 0, RS_SETTING, RS_MEASURED, RS_COUNTER };
+
+// Register descriptor
+struct RegDescriptor {
+  uint16_t address;      // Register number
+  uint8_t width;         // Number of registers used
+  RegEncoding encoding;  // Value encoding
+  bool writable;         // true if FC06/FC10 may change it
+  uint16_t minVal;       // Lowest value allowed for a write (the server ID for RE_SID*)
+  uint16_t maxVal;       // Highest value allowed for a write (the server ID for RE_SID*)
+  RegField field;        // Data field bound to it
+  uint8_t index;         // Sensor 0/1 or target/combination 2
+  RegSource source;      // Source of the value
+  const char *name;      // Readable name (host only)
+};
+
+constexpr RegDescriptor REGISTERS[] = {
+// address width encoding   writable  min   max    field          index source       name
+  {  1, 1, RE_BOOL,      true,     0,     1, RF_MASTER,       0, RS_SETTING,  REGNAME("master switch") },
+  {  2, 2, RE_FLOAT,     false,    0,     0, RF_VALUE_TEMP,   0, RS_MEASURED, REGNAME("S0 temperature") },
+  {  4, 2, RE_FLOAT,     false,    0,     0, RF_VALUE_HUM,    0, RS_MEASURED, REGNAME("S0 humidity") },
+  {  6, 2, RE_FLOAT,     false,    0,     0, RF_VALUE_DEW,    0, RS_MEASURED, REGNAME("S0 dew point") },
+  {  8, 2, RE_FLOAT,     false,    0,     0, RF_VALUE_TEMP,   1, RS_MEASURED, REGNAME("S1 temperature") },
+  { 10, 2, RE_FLOAT,     false,    0,     0, RF_VALUE_HUM,    1, RS_MEASURED, REGNAME("S1 humidity") },
+  { 12, 2, RE_FLOAT,     false,    0,     0, RF_VALUE_DEW,    1, RS_MEASURED, REGNAME("S1 dew point") },
+  { 14, 1, RE_BOOL,      false,    0,     1, RF_SWITCHED,     2, RS_MEASURED, REGNAME("target state") },
+  { 15, 1, RE_UINT16,    false,    0,     0, RF_RESTARTS,     0, RS_COUNTER,  REGNAME("restarts") },
+  { 16, 1, RE_UINT16,    false,    0,     0, RF_RUNTIME,      0, RS_COUNTER,  REGNAME("run time") },
+  { 17, 1, RE_UINT16,    false,    0,     0, RF_HEALTH,       0, RS_MEASURED, REGNAME("S0 health") },
+  { 18, 1, RE_UINT16,    false,    0,     0, RF_HEALTH,       1, RS_MEASURED, REGNAME("S1 health") },
+  { 19, 1, RE_UINT16,    false,    0,     0, RF_HEALTH,       2, RS_MEASURED, REGNAME("target health") },
+  { 20, 1, RE_UINT16,    true,    10,  3600, RF_INTERVAL,     0, RS_SETTING,  REGNAME("measuring interval") },
+  { 21, 1, RE_UINT16,    true,     1,    16, RF_HYSTERESIS,   0, RS_SETTING,  REGNAME("hysteresis steps") },
+  { 22, 1, RE_UINT16,    true,     0,     2, RF_TYPE,         0, RS_SETTING,  REGNAME("S0 type") },
+  { 23, 1, RE_IP_HI,     true,     0, 65535, RF_IP,           0, RS_SETTING,  REGNAME("S0 IP 0/1") },
+  { 24, 1, RE_IP_LO,     true,     0, 65535, RF_IP,           0, RS_SETTING,  REGNAME("S0 IP 2/3") },
+  { 25, 1, RE_UINT16,    true,     1, 65535, RF_PORT,         0, RS_SETTING,  REGNAME("S0 port") },
+  { 26, 1, RE_SID_SLOT,  true,     1,   247, RF_SID,          0, RS_SETTING,  REGNAME("S0 server ID/slot") },
+  { 27, 1, RE_CONDITION, true,     0, 65535, RF_COND_TEMP,    0, RS_SETTING,  REGNAME("S0 temperature condition") },
+  { 28, 1, RE_CONDITION, true,     0, 65535, RF_COND_HUM,     0, RS_SETTING,  REGNAME("S0 humidity condition") },
+  { 29, 1, RE_CONDITION, true,     0, 65535, RF_COND_DEW,     0, RS_SETTING,  REGNAME("S0 dew point condition") },
+  { 30, 1, RE_UINT16,    true,     0,     2, RF_TYPE,         1, RS_SETTING,  REGNAME("S1 type") },
+  { 31, 1, RE_IP_HI,     true,     0, 65535, RF_IP,           1, RS_SETTING,  REGNAME("S1 IP 0/1") },
+  { 32, 1, RE_IP_LO,     true,     0, 65535, RF_IP,           1, RS_SETTING,  REGNAME("S1 IP 2/3") },
+  { 33, 1, RE_UINT16,    true,     1, 65535, RF_PORT,         1, RS_SETTING,  REGNAME("S1 port") },
+  { 34, 1, RE_SID_SLOT,  true,     1,   247, RF_SID,          1, RS_SETTING,  REGNAME("S1 server ID/slot") },
+  { 35, 1, RE_CONDITION, true,     0, 65535, RF_COND_TEMP,    1, RS_SETTING,  REGNAME("S1 temperature condition") },
+  { 36, 1, RE_CONDITION, true,     0, 65535, RF_COND_HUM,     1, RS_SETTING,  REGNAME("S1 humidity condition") },
+  { 37, 1, RE_CONDITION, true,     0, 65535, RF_COND_DEW,     1, RS_SETTING,  REGNAME("S1 dew point condition") },
+  { 38, 1, RE_UINT16,    true,     0,     2, RF_TYPE,         2, RS_SETTING,  REGNAME("target type") },
+  { 39, 1, RE_IP_HI,     true,     0, 65535, RF_IP,           2, RS_SETTING,  REGNAME("target IP 0/1") },
+  { 40, 1, RE_IP_LO,     true,     0, 65535, RF_IP,           2, RS_SETTING,  REGNAME("target IP 2/3") },
+  { 41, 1, RE_UINT16,    true,     1, 65535, RF_PORT,         2, RS_SETTING,  REGNAME("target port") },
+  { 42, 1, RE_SID,       true,     1,   247, RF_SID,          2, RS_SETTING,  REGNAME("target server ID") },
+  { 43, 1, RE_CONDITION, true,     0, 65535, RF_COND_TEMP,    2, RS_SETTING,  REGNAME("temperature difference condition") },
+  { 44, 1, RE_CONDITION, true,     0, 65535, RF_COND_HUM,     2, RS_SETTING,  REGNAME("humidity difference condition") },
+  { 45, 1, RE_CONDITION, true,     0, 65535, RF_COND_DEW,     2, RS_SETTING,  REGNAME("dew point difference condition") },
+  { 46, 1, RE_UINT16,    false,    0,     0, RF_CSTATE,       0, RS_MEASURED, REGNAME("condition state") },
+  { 47, 1, RE_BOOL,      true,     0,     1, RF_FALLBACK,     0, RS_SETTING,  REGNAME("fallback switch") },
+  { 48, 1, RE_UINT16,    true,    24,  1440, RF_HIST_SLOTS,   0, RS_SETTING,  REGNAME("history slots") },
+  { 49, 1, RE_UINT16,    false,    0,     0, RF_HIST_ADDRESS, 0, RS_CONST,    REGNAME("history address") },
+  { 50, 1, RE_UINT16,    false,    0,     0, RF_HIST_CURRENT, 0, RS_COUNTER,  REGNAME("current history slot") },
+  { 51, 1, RE_BOOL,      true,     0,     1, RF_COMMIT,       0, RS_SETTING,  REGNAME("settings commit") },
+  { REG_EVENTCOUNT, 1, RE_UINT16, false, 0, 0, RF_EVENT_SLOTS, 0, RS_CONST,   REGNAME("event slots") },
+};
+const size_t REGCOUNT = sizeof(REGISTERS) / sizeof(REGISTERS[0]);
+
+// Index from register address to descriptor (-1: register not described)
+struct RegIndex {
+  int8_t slot[REG_EVENTS];
+};
+
+constexpr RegIndex makeRegIndex() {
+  RegIndex ri {};
+  for (uint16_t a = 0; a < REG_EVENTS; a++) {
+    ri.slot[a] = -1;
+  }
+  for (size_t i = 0; i < REGCOUNT; i++) {
+    for (uint8_t w = 0; w < REGISTERS[i].width; w++) {
+      ri.slot[REGISTERS[i].address + w] = i;
+    }
+  }
+  return ri;
+}
+constexpr RegIndex REGINDEX = makeRegIndex();
+
+// checkRegisters: descriptors must be in range and may not overlap
+constexpr bool checkRegisters() {
+  uint16_t next = 1;
+  for (size_t i = 0; i < REGCOUNT; i++) {
+    if (REGISTERS[i].address < next || REGISTERS[i].address + REGISTERS[i].width > REG_EVENTS) return false;
+    next = REGISTERS[i].address + REGISTERS[i].width;
+  }
+  return true;
+}
+static_assert(checkRegisters(), "Register descriptors must be sorted, in range and not overlapping");
+
+// findRegister: get the descriptor covering a register address, or nullptr if there is none
+constexpr const RegDescriptor *findRegister(uint16_t address) {
+  return (address < REG_EVENTS && REGINDEX.slot[address] >= 0) ? &REGISTERS[REGINDEX.slot[address]] : nullptr;
+}
+
+// regAddress: get the address of the register bound to a field (0 if there is none)
+// This is a linear search, meant to be evaluated at compile time.
+constexpr uint16_t regAddress(RegField field, uint8_t index = 0) {
+  for (size_t i = 0; i < REGCOUNT; i++) {
+    if (REGISTERS[i].field == field && REGISTERS[i].index == index) return REGISTERS[i].address;
+  }
+  return 0;
+}
+
+// Input registers (FC04): all live values in one read-only block of int16 fixed point numbers.
+// Temperatures, humidities and dew points are given in 1/100 units, IR_INVALID marks a missing value.
+enum InputRegister : uint16_t {
+  IR_SEQUENCE = 1,    // Measurement sequence number, incremented with each evaluated measurement cycle
+  IR_S0_TEMP,         // S0 temperature
+  IR_S0_HUM,          // S0 humidity
+  IR_S0_DEW,          // S0 dew point
+  IR_S1_TEMP,         // S1 temperature
+  IR_S1_HUM,          // S1 humidity
+  IR_S1_DEW,          // S1 dew point
+  IR_SWITCHED,        // Target state, 0=OFF, 1=ON
+  IR_S0_HEALTH,       // S0 health tracker
+  IR_S1_HEALTH,       // S1 health tracker
+  IR_TARGET_HEALTH,   // Target health tracker
+  IR_CSTATE,          // Condition state
+  IR_RUNTIME,         // Run time since last restart in minutes
+  IR_END              // First register behind the block
+};
+const int16_t IR_INVALID(-32768);
+const float IR_SCALE(100.0);
+
+// toFixed: convert a value to the input register fixed point format
+inline int16_t toFixed(float value) {
+  // NaN or out of range?
+  if (!(value > -327.67 && value < 327.67)) return IR_INVALID;
+  return (int16_t)(value * IR_SCALE + (value < 0 ? -0.5 : 0.5));
+}
+
+// fromFixed: convert an input register fixed point value back (NaN for IR_INVALID)
+inline float fromFixed(int16_t value) {
+  return (value == IR_INVALID) ? NAN : value / IR_SCALE;
+}
+
+// History frames (FC45): the history slots in a compact binary format.
+// Request:  SID, 0x45, version (uint8_t), first slot (uint16_t), number of slots (uint16_t, HF_ALL: up to the last)
+// Response: SID, 0x45, version (uint8_t), history slots (uint16_t), current slot (uint16_t),
+//           first slot (uint16_t), number of entries (uint8_t), continuation (uint16_t), entries
+// Each entry has the encoded values of a slot: S0 temperature, S0 humidity, S1 temperature,
+// S1 humidity (uint16_t each, encoded like the history registers) and the target ON percentage (uint8_t).
+// A frame will not exceed the Modbus PDU size, so a range may need several frames. The continuation
+// is the first slot to request next with the remaining number of slots, HF_END if the range is complete.
+const uint8_t HF_VERSION(1);                                // Frame format version
+const uint16_t HF_ALL(0xFFFF);                              // Number of slots: all up to the last
+const uint16_t HF_END(0xFFFF);                              // Continuation: range complete
+const uint8_t HF_HEADER(10);                                // Frame header bytes behind the function code
+const uint8_t HF_ENTRY(9);                                  // Bytes per entry
+const uint8_t HF_MAXENTRIES((252 - HF_HEADER) / HF_ENTRY);  // Entries fitting into a PDU (253 bytes with the FC)
+
+// Tier frames (FC45 version 2): the history tiers with sample count, average, minimum and maximum.
+// Request:  SID, 0x45, version (uint8_t), tier (uint8_t), first entry (uint16_t), number of entries (uint16_t, HF_ALL)
+// Response: SID, 0x45, version (uint8_t), tier (uint8_t), tier entries (uint16_t), current entry (uint16_t),
+//           first entry (uint16_t), number of entries (uint8_t), continuation (uint16_t), entries
+// Each entry has the start of its period (uint32_t, Unix time, 0 if empty), the number of samples (uint16_t),
+// the target ON percentage (uint8_t), then the averages, minima and maxima (4 x uint16_t each) of
+// S0 temperature, S0 humidity, S1 temperature and S1 humidity, encoded like the history registers.
+// Minima and maxima are 0 without valid samples. The hour and day tiers are rings: an entry
+// older than the tier's range is left over from a previous round and may be skipped.
+enum HistoryTierID : uint8_t { HT_SLOTS = 0, HT_HOURS, HT_DAYS, HT_END };
+const uint8_t HF_TIERS(2);                                  // Frame format version with tiers
+const uint8_t HF_TIERHEADER(11);                            // Frame header bytes behind the function code
+const uint8_t HF_TIERENTRY(31);                             // Bytes per entry
+const uint8_t HF_MAXTIERENTRIES((252 - HF_TIERHEADER) / HF_TIERENTRY);  // Entries fitting into a PDU
+
+// Condition encoding helpers
+inline uint16_t encodeCondition(uint8_t type, float value) {
+  return ((type & 0x03) << 14) | ((int(value * 10) + 2048) & 0x0FFF);
+}
+inline uint8_t conditionType(uint16_t reg) { return (reg >> 14) & 0x03; }
+inline float conditionValue(uint16_t reg) { return int((reg & 0x0FFF) - 2048) / 10.0; }
+const uint8_t COND_RESERVED(3);                             // Condition type not to be used
+
+// Result of a register write check
+enum RegCheck : uint8_t { RC_OK = 0, RC_ADDRESS, RC_VALUE };
+
+// checkWrite: check if a value may be written to a register
+inline RegCheck checkWrite(uint16_t address, uint16_t value) {
+  const RegDescriptor *r = findRegister(address);
+
+  // Does the register exist and is it write-enabled?
+  if (!r || !r->writable) return RC_ADDRESS;
+  // Yes. The limits apply to the server ID part for SID registers
+  uint16_t checked = value;
+  if (r->encoding == RE_SID_SLOT || r->encoding == RE_SID) {
+    checked = (value >> 8) & 0xFF;
+    // Only slots 0 and 1 are known
+    if (r->encoding == RE_SID_SLOT && (value & 0xFF) > 1) return RC_VALUE;
+  } else if (r->encoding == RE_CONDITION && conditionType(value) == COND_RESERVED) {
+    return RC_VALUE;
+  } else if (r->field == RF_HIST_SLOTS && value && 1440 % value) {
+    // Slots need to be whole minutes long
+    return RC_VALUE;
+  }
+  if (checked < r->minVal || checked > r->maxVal) return RC_VALUE;
+  return RC_OK;
+}
+
+#endif
@@ -3,27 +3,36 @@
 
 #include "Blinker.h"
 
+bool Blinker::B_changed = false;
+
 // Constructor: takes GPIO of LED to handle
 Blinker::Blinker(uint8_t port, bool onState) :
   B_port(port),
-  B_onState(onState) {
+  B_onState(onState),
+  B_isOn(true) {
   pinMode(port, OUTPUT);
   stop();
 }
   
 // start: in interval steps, loop over blinking pattern
-uint32_t Blinker::start(uint16_t pattern, uint32_t interval) {
+uint32_t Blinker::start(uint64_t pattern, uint32_t interval) {
+  // An empty pattern is just a LED off
+  if (!pattern) {
+    stop();
+    return millis();
+  }
   B_interval = interval;
   B_pattern = pattern;
-  B_pLength = 16;
+  B_pLength = 64;
   // Shift B_pattern left until the first '1' bit is found
-  while (B_pLength && !(B_pattern & 0x8000)) {
+  while (!(B_pattern & 0x8000000000000000ULL)) {
     B_pattern <<= 1;
     B_pLength --;
   }
   B_pWork = B_pattern;
   B_counter = 0;
   B_lastTick = millis();
+  B_changed = true;
   return B_lastTick + B_interval;
 }
 
@@ -33,25 +42,30 @@ void Blinker::stop() {
   B_interval = 0;
   B_pattern = 0;
   B_counter = 0;
-  digitalWrite(B_port, !B_onState);
+  B_changed = true;
+  set(false);
+}
+
+// set: switch the LED, if its state differs
+void Blinker::set(bool on) {
+  if (on != B_isOn) {
+    digitalWrite(B_port, on ? B_onState : !B_onState);
+    B_isOn = on;
+  }
 }
 
 // update: check if the blinking pattern needs to be advanced a step
 void Blinker::update() {
+  update(millis());
+}
+
+void Blinker::update(uint32_t now) {
   // Do we have a valid interval?
   if (B_interval) {
     // Yes. Has it passed?
-    if (millis() - B_lastTick > B_interval) {
-      // Yes. get the current state of the LED pin
-      bool state = digitalRead(B_port);
-      // Does the pattern require an ON?
-      if (B_pWork & 0x8000) {             
-        // Yes. switch LED ON, if was OFF
-        if (state != B_onState) digitalWrite(B_port, B_onState);
-      } else { 
-        // No, OFF requested. switch LED OFF, if was ON
-        if (state == B_onState) digitalWrite(B_port, !B_onState);
-      }
+    if (now - B_lastTick >= B_interval) {
+      // Yes. Switch LED as the pattern requires
+      set(B_pWork & 0x8000000000000000ULL);
       // Advance pattern
       B_pWork <<= 1;
       // Overflow?
@@ -60,7 +74,47 @@ void Blinker::update() {
         B_counter = 0;
         B_pWork = B_pattern;
       }
-      B_lastTick = millis();
+      // Next step is relative to the last to avoid drift - unless we are lagging a full interval
+      B_lastTick += B_interval;
+      if (now - B_lastTick >= B_interval) B_lastTick = now;
+    }
+  }
+}
+
+LedEngine::LedEngine() :
+  E_count(0),
+  E_active(false),
+  E_nextDue(0),
+  E_onMask(0) { }
+
+// add: take a Blinker under control
+bool LedEngine::add(Blinker& b) {
+  if (E_count >= LEDENGINE_MAX) return false;
+  E_leds[E_count++] = &b;
+  Blinker::B_changed = true;
+  return true;
+}
+
+// update: advance all Blinkers that are due
+void LedEngine::update() {
+  uint32_t now = millis();
+  // Nothing changed and nothing due?
+  if (!Blinker::B_changed && (!E_active || (int32_t)(now - E_nextDue) < 0)) {
+    // Yes. Nothing to do.
+    return;
+  }
+  Blinker::B_changed = false;
+  // Advance all Blinkers and find the next deadline
+  E_active = false;
+  E_onMask = 0;
+  for (uint8_t i = 0; i < E_count; ++i) {
+    Blinker *b = E_leds[i];
+    b->update(now);
+    if (b->active()) {
+      uint32_t due = b->due();
+      if (!E_active || (int32_t)(due - E_nextDue) < 0) E_nextDue = due;
+      E_active = true;
     }
+    if (b->isOn()) E_onMask |= (1 << i);
   }
 }
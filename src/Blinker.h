@@ -2,17 +2,18 @@
 // Copyright 2020 by miq1@gmx.de
 
 // Blinker is a class to apply arbitrary blinking patterns to a LED.
-// Blinker patterns are 16-bit uint16_t bit maps, where a '1' means 'LED ON'
+// Blinker patterns are 16-, 32- or 64-bit bit maps, where a '1' means 'LED ON'
 // and a '0' is 'LED OFF'. Sequences of '1' or '0' are treated as a longer
 // stable period.
 // NOTE: leading '0' in the pattern are ignored - the pattern will start at the first '1'!
 // The time length of 1 bit is given by the interval parameter to start().
 // Example:
-//   start(100, 0xF0F0);
+//   start(0xF0F0, 100);
 // will turn the LED ON for 400ms, switch it off again for 400ms and repeat that
 // 'F' is 4 bits '1' in a row ==> 4 * 100 = 400
 // NOTE: the update() call must be done in shorter intervals as those in the 
 // start() call for Blinker to be able to cleanly maintain the requested pattern!
+// A LedEngine can do that for a set of Blinkers, calling update() only if one is due.
 
 #ifndef _BLINKER_H
 #define _BLINKER_H
@@ -21,30 +22,70 @@
 
 #define BLINKER_DEFAULT 250
 #define BLINKER_PATTERN 0xF000
+#define LEDENGINE_MAX 8
 
 // Blinker: helper class to maintain blinking patterns for the LED
 class Blinker {
+  friend class LedEngine;
 public:
   // Constructor: takes GPIO of LED to handle
   explicit Blinker(uint8_t port, bool onState = HIGH);
   
   // start: in interval steps, loop over blinking pattern
-  uint32_t start(uint16_t pattern = BLINKER_PATTERN, uint32_t interval = BLINKER_DEFAULT);
+  // As leading '0' bits are ignored, 16-, 32- and 64-bit patterns all may be given here.
+  uint32_t start(uint64_t pattern = BLINKER_PATTERN, uint32_t interval = BLINKER_DEFAULT);
 
   // stop: stop blinking
   void stop();
 
   // update: check if the blinking pattern needs to be advanced a step
   void update();
+  void update(uint32_t now);
+
+  // isOn: get the current LED state without reading back the GPIO
+  inline bool isOn() const { return B_isOn; }
+
+  // active: true if a pattern is running
+  inline bool active() const { return B_interval != 0; }
+
+  // due: time the next pattern step is due (only sensible if active)
+  inline uint32_t due() const { return B_lastTick + B_interval; }
 
 protected:
   uint8_t  B_counter;      // Number of bit currently processed
   uint8_t  B_port;         // GPIO of the LED
-  uint16_t B_pattern;      // 16-bit blinking pattern
-  uint16_t B_pWork;        // 16-bit work pattern
+  uint64_t B_pattern;      // Blinking pattern, left-aligned
+  uint64_t B_pWork;        // Work pattern
   uint8_t  B_pLength;      // used length of the blinking pattern
   uint32_t B_lastTick;     // Last interval start time
   uint32_t B_interval;     // Length of interval in milliseconds
   bool     B_onState;      // Pin state to switch the LED ON
+  bool     B_isOn;         // Cached LED state
+  static bool B_changed;   // Set by start() and stop() to notify a LedEngine
+
+  // set: switch the LED, if its state differs
+  void set(bool on);
+};
+
+// LedEngine: advance the patterns of a set of Blinkers with a single deadline check
+class LedEngine {
+public:
+  LedEngine();
+
+  // add: take a Blinker under control. Returns false if LEDENGINE_MAX Blinkers are taken already.
+  bool add(Blinker& b);
+
+  // update: advance all Blinkers that are due. Cheap if none is due, so may be called in every loop()
+  void update();
+
+  // onMask: get the LED states as bit mask, bit 0 being the first Blinker added
+  inline uint32_t onMask() const { return E_onMask; }
+
+protected:
+  Blinker *E_leds[LEDENGINE_MAX];   // Blinkers controlled
+  uint8_t E_count;                  // Number of Blinkers in E_leds
+  bool E_active;                    // true if at least one Blinker is running a pattern
+  uint32_t E_nextDue;               // Time the next Blinker is due
+  uint32_t E_onMask;                // Cached LED states
 };
 #endif
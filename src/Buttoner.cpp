@@ -11,7 +11,14 @@ Buttoner::Buttoner(int port, bool onState, bool pullUp, uint32_t queueSize) :
   BE_pressTime(BE_defaultPT),
   BE_state(BS_IDLE),
   BE_keyState(0),
-  BE_stateTimer(0) {
+  BE_stateTimer(0),
+  BE_eventList(true),
+  BE_interrupt(false),
+  BE_level(false),
+  BE_levelSince(0),
+  BE_stable(false) {
+  // Limit queue size to the event buffer
+  if (!BE_queueSize || BE_queueSize > BE_maxEvents) BE_queueSize = BE_maxEvents;
   // If pullUp is set, configure the GPIO accordingly
   if (pullUp) {
     pinMode(BE_port, INPUT_PULLUP);
@@ -20,20 +27,39 @@ Buttoner::Buttoner(int port, bool onState, bool pullUp, uint32_t queueSize) :
   }
 }
 
+void Buttoner::enableInterrupt() {
+  if (BE_interrupt) return;
+  // Start with the current button state
+  BE_level = BE_stable = (digitalRead(BE_port) == BE_onState);
+  BE_levelSince = millis();
+  BE_edges.clear();
+  BE_interrupt = true;
+  attachInterruptArg(digitalPinToInterrupt(BE_port), edgeISR, this, CHANGE);
+}
+
+// edgeISR: record the new button state with a timestamp. Nothing else is done here!
+void IRAM_ATTR Buttoner::edgeISR(void *arg) {
+  Buttoner *b = static_cast<Buttoner *>(arg);
+  // If the edge buffer is full, the edge is lost. update() will resync the level.
+  b->BE_edges.push_back(Edge { (uint32_t)millis(), digitalRead(b->BE_port) == b->BE_onState });
+}
+
 ButtonEvent Buttoner::getEvent() {
+  if (BE_interrupt) update();
   if (BE_eventList.empty()) return BE_NONE;
-  ButtonEvent be = BE_eventList.front();
-  BE_eventList.pop();
+  ButtonEvent be = BE_eventList[0];
+  BE_eventList.pop(1);
   return be;
 }
 
 ButtonEvent Buttoner::peekEvent() {
+  if (BE_interrupt) update();
   if (BE_eventList.empty()) return BE_NONE;
-  return BE_eventList.front();
+  return BE_eventList[0];
 }
 
 void Buttoner::clearEvents() {
-  queue<ButtonEvent>().swap(BE_eventList);
+  BE_eventList.clear();
 }
 
 void Buttoner::setTiming(uint32_t doubleClickTime, uint32_t pressTime) {
@@ -41,7 +67,42 @@ void Buttoner::setTiming(uint32_t doubleClickTime, uint32_t pressTime) {
   BE_pressTime = pressTime;
 }
 
+void Buttoner::addEvent(ButtonEvent be) {
+  if (BE_eventList.size() < BE_queueSize) BE_eventList.push_back(be);
+}
+
+void Buttoner::settle(uint32_t now) {
+  // Did the raw level differ from the debounced state long enough?
+  if (BE_level != BE_stable && now - BE_levelSince >= BE_debounce) {
+    // Yes. Let the state machine see timeouts up to the change first, then the change itself
+    uint32_t t = BE_levelSince + BE_debounce;
+    advance(BE_stable, t);
+    BE_stable = BE_level;
+    advance(BE_stable, t);
+  }
+}
+
 int Buttoner::update() {
+  if (BE_interrupt) {
+    Edge e;
+    // Replay all edges recorded since the last call
+    while (BE_edges.pop(e)) {
+      settle(e.stamp);
+      BE_level = e.pressed;
+      BE_levelSince = e.stamp;
+    }
+    uint32_t now = millis();
+    // Catch up if the last edge was lost on a full edge buffer
+    bool pressed = (digitalRead(BE_port) == BE_onState);
+    if (pressed != BE_level && BE_edges.empty()) {
+      BE_level = pressed;
+      BE_levelSince = now;
+    }
+    settle(now);
+    advance(BE_stable, now);
+    return BE_eventList.size();
+  }
+
   // We do not sample in less than 5ms intervals
   if (millis() - BE_stateTimer < 5) {
     return -1;
@@ -53,15 +114,18 @@ int Buttoner::update() {
   // to determine the button state (= 50ms)
   const uint16_t SAMPLES(0xFC00);
   BE_keyState = (BE_keyState << 1) | (digitalRead(BE_port) != BE_onState) | SAMPLES;
-  bool buttonState = (BE_keyState == SAMPLES);
+  advance(BE_keyState == SAMPLES, BE_stateTimer);
+  return BE_eventList.size();
+}
 
+void Buttoner::advance(bool buttonState, uint32_t now) {
   // State machine...
   switch (BE_state) {
   case BS_IDLE:  // Waiting for something to happen
     // Button pressed?
     if (buttonState) {
       // Yes. Wind up timer and proceed to next state
-      BE_timer = millis();
+      BE_timer = now;
       BE_state = BS_CLICKED1;
     }
     break;
@@ -69,9 +133,9 @@ int Buttoner::update() {
     // Button still held down?
     if (buttonState) {
       // Yes. Did the holding time pass?
-      if (millis() - BE_timer > BE_pressTime) {
+      if (now - BE_timer > BE_pressTime) {
         // Yes. Report a PRESS event
-        if (!BE_queueSize || BE_eventList.size() < BE_queueSize)  BE_eventList.push(BE_PRESS);
+        addEvent(BE_PRESS);
         // Go into cooldown phase to have the button released again
         BE_state = BS_COOLDOWN;
       }
@@ -82,16 +146,16 @@ int Buttoner::update() {
     break;
   case BS_RELEASED1: // Button was released after the first click
     // Did the time for double clicks pass without another click?
-    if (millis() - BE_timer > BE_doubleClickTime) {
+    if (now - BE_timer > BE_doubleClickTime) {
       // Yes. report a single click then. No cooldown required!
-      if (!BE_queueSize || BE_eventList.size() < BE_queueSize)  BE_eventList.push(BE_CLICK);
+      addEvent(BE_CLICK);
       BE_state = BS_IDLE;
     } else {
       // No, still waiting for second click.
       // Was the button clicked again?
       if (buttonState) {
         // Yes. Report double click and proceed to cooldown
-        if (!BE_queueSize || BE_eventList.size() < BE_queueSize)  BE_eventList.push(BE_DOUBLECLICK);
+        addEvent(BE_DOUBLECLICK);
         BE_state = BS_COOLDOWN;
       }
     }
@@ -104,5 +168,4 @@ int Buttoner::update() {
   default: // May not get here, but lint likes it...
     break;
   }
-  return BE_eventList.size();
 }
@@ -4,13 +4,13 @@
 // Buttoner maintains a click button connected to a GPIO.
 // It can register single and double clicks and a long press.
 // Button events are kept in a queue for serial processing
+// The button may either be polled by update() or be watched by an edge interrupt (see enableInterrupt()).
 // 
 #ifndef _BUTTONER_H
 #define _BUTTONER_H
 #include <Arduino.h>
-#include <queue>
-
-using std::queue;
+#include "RingBuf.h"
+#include "RingBufSPSC.h"
 
 // Reported events
 enum ButtonEvent : uint8_t { BE_NONE = 0, BE_CLICK, BE_DOUBLECLICK, BE_PRESS };
@@ -18,6 +18,11 @@ enum ButtonEvent : uint8_t { BE_NONE = 0, BE_CLICK, BE_DOUBLECLICK, BE_PRESS };
 // Timing values
 const uint32_t BE_defaultDCT(250);   // maximum time between clicks of a double click
 const uint32_t BE_defaultPT(400);    // holding time to determine a held button
+const uint32_t BE_debounce(50);      // time a button level must be stable to be taken
+
+// Queue sizes
+const size_t BE_maxEvents(8);        // maximum number of events held
+const size_t BE_maxEdges(32);        // number of button edges buffered by the interrupt handler (power of 2!)
 
 class Buttoner {
 public:
@@ -25,11 +30,18 @@ public:
   // - port: GPIO number (mandatory)
   // - onState: logic level of the GPIO when the button is pressed
   // - pullUp: set to true to have the GPIO configured as INPUT_PULLUP
-  // - queueSize: number of events to keep (0=unlimited)
+  // - queueSize: number of events to keep (0 or more than BE_maxEvents: BE_maxEvents)
   explicit Buttoner(int port, bool onState = HIGH, bool pullUp = false, uint32_t queueSize = 4);
 
-  // update: polling function to read the button state and generate events. This function
-  // needs to be called frequently!
+  // enableInterrupt: switch from polling to an edge interrupt on the GPIO.
+  // Must be called in setup(), not in a global constructor!
+  // The interrupt handler only records the timestamped edges, the events are
+  // evaluated from these when update() or any of the event functions is called.
+  void enableInterrupt();
+
+  // update: function to read the button state and generate events.
+  // In polling mode, this function needs to be called frequently!
+  // In interrupt mode, it is only evaluating the edges recorded since the last call.
   // Returns the number of events currently held in queue
   int update();
 
@@ -63,7 +75,27 @@ protected:
   uint32_t BE_timer;               // Timer watching the clicking times
   uint16_t BE_keyState;            // Shift register to hold sampled button states
   uint32_t BE_stateTimer;          // Timer to maintain polling interval
-  queue<ButtonEvent> BE_eventList; // Queue of events
+  RingBuf<ButtonEvent, BE_maxEvents> BE_eventList; // Queue of events
+
+  // Interrupt mode data
+  struct Edge {
+    uint32_t stamp;                // millis() at the edge
+    bool pressed;                  // button state after the edge
+  };
+  bool BE_interrupt;               // true if interrupt mode is active
+  bool BE_level;                   // last raw button state seen
+  uint32_t BE_levelSince;          // time of the last raw state change
+  bool BE_stable;                  // debounced button state
+  RingBufSPSC<Edge, BE_maxEdges> BE_edges; // Edges recorded by the interrupt handler
+
+  // advance: run the state machine for a (debounced) button state at time now
+  void advance(bool pressed, uint32_t now);
+  // addEvent: put an event into the queue, if there is room
+  void addEvent(ButtonEvent be);
+  // settle: take the raw level as stable, if it did not change until time now
+  void settle(uint32_t now);
+  // Interrupt handler
+  static void IRAM_ATTR edgeISR(void *arg);
 };
 
 #endif
@@ -0,0 +1,88 @@
+// ClientPool
+// Copyright 2021 by miq1@gmx.de
+
+#include "ClientPool.h"
+
+ClientPool::ClientPool() {
+  for (uint8_t i = 0; i < CLIENTPOOL_MAX; i++) {
+    CP_clients[i] = nullptr;
+    CP_ep[i].port = 0;
+    CP_ep[i].seq = 0;
+    CP_ep[i].lastUse = 0;
+    CP_ep[i].bound = false;
+    memset(CP_ep[i].sent, 0, sizeof(CP_ep[i].sent));
+  }
+}
+
+// begin: create the clients and register the response handlers
+void ClientPool::begin(MBOnData onData, MBOnError onError, uint32_t timeout, uint32_t idleTimeout) {
+  for (uint8_t i = 0; i < CLIENTPOOL_MAX; i++) {
+    if (!CP_clients[i]) {
+      CP_clients[i] = new ModbusClientTCPasync(CLIENTPOOL_QUEUE);
+    }
+    CP_clients[i]->setTimeout(timeout);
+    CP_clients[i]->setIdleTimeout(idleTimeout);
+    CP_clients[i]->onDataHandler(onData);
+    CP_clients[i]->onErrorHandler(onError);
+  }
+}
+
+// endpoint: get the endpoint number for ip:port
+int8_t ClientPool::endpoint(IPAddress ip, uint16_t port) {
+  int8_t candidate = -1;
+
+  for (uint8_t i = 0; i < CLIENTPOOL_MAX; i++) {
+    if (!CP_clients[i]) continue;
+    Endpoint& e = CP_ep[i];
+    // Bound to this endpoint already?
+    if (e.bound && e.ip == ip && e.port == port) {
+      // Yes, take it
+      e.lastUse = millis();
+      return i;
+    }
+    // Keep track of the best client to rebind: an unbound one, else the least recently used idle one
+    if (!e.bound) {
+      if (candidate < 0 || CP_ep[candidate].bound) candidate = i;
+    } else if (CP_clients[i]->pendingRequests() == 0) {
+      if (candidate < 0 || (CP_ep[candidate].bound && (int32_t)(e.lastUse - CP_ep[candidate].lastUse) < 0)) candidate = i;
+    }
+  }
+  // Did we find a client to bind?
+  if (candidate >= 0) {
+    // Yes. Close a connection to the previous endpoint and bind it
+    Endpoint& e = CP_ep[candidate];
+    if (e.bound) {
+      CP_clients[candidate]->disconnect();
+    }
+    CP_clients[candidate]->setTarget(ip, port);
+    e.ip = ip;
+    e.port = port;
+    e.lastUse = millis();
+    e.bound = true;
+  }
+  return candidate;
+}
+
+// addRequest: send a prepared request message of the given kind to ip:port
+Error ClientPool::addRequest(IPAddress ip, uint16_t port, uint8_t kind, ModbusMessage msg) {
+  int8_t ep = endpoint(ip, port);
+  if (ep < 0) return REQUEST_QUEUE_FULL;
+  uint32_t token = nextToken(ep, kind);
+  Error e = CP_clients[ep]->addRequest(msg, token);
+  if (e == SUCCESS) stamp(token);
+  return e;
+}
+
+// setTimeout: set the response timeout for requests to ip:port
+bool ClientPool::setTimeout(IPAddress ip, uint16_t port, uint32_t timeout) {
+  int8_t ep = endpoint(ip, port);
+  if (ep < 0) return false;
+  CP_clients[ep]->setTimeout(timeout);
+  return true;
+}
+
+// nextToken: count up the sequence number and build the token
+uint32_t ClientPool::nextToken(int8_t ep, uint8_t kind) {
+  CP_ep[ep].seq++;
+  return ((uint32_t)ep << 24) | ((uint32_t)kind << 16) | CP_ep[ep].seq;
+}
@@ -0,0 +1,84 @@
+// ClientPool
+// Copyright 2021 by miq1@gmx.de
+//
+// ClientPool holds a fixed set of Modbus TCP clients, each bound to one endpoint (IP address and port).
+// Connections are kept open between requests, so a measurement cycle does not need new TCP handshakes,
+// and each endpoint has its own request queue - requests can not end up at the wrong host.
+// If more endpoints are used than clients are available, the least recently used idle client is rebound.
+//
+// Each request gets a token of the form endpoint << 24 | kind << 16 | sequence number,
+// where kind is the caller's request type. The response handlers may take it apart with
+// endpointOf(), kindOf() and seqOf().
+// The time a request was sent is kept by its token, so elapsed() will give the round trip time
+// when the response or error has arrived.
+
+#ifndef _CLIENTPOOL_H
+#define _CLIENTPOOL_H
+
+#include <Arduino.h>
+#include <IPAddress.h>
+#include "ModbusClientTCPAsync.h"
+
+#define CLIENTPOOL_MAX 6
+#define CLIENTPOOL_QUEUE 10
+
+class ClientPool {
+public:
+  ClientPool();
+
+  // begin: create the clients and register the response handlers
+  // - timeout: ms to wait for a response
+  // - idleTimeout: ms an unused connection is kept open
+  void begin(MBOnData onData, MBOnError onError, uint32_t timeout, uint32_t idleTimeout);
+
+  // endpoint: get the endpoint number for ip:port, binding a client if necessary.
+  // Returns -1 if all clients are bound to other endpoints and are busy.
+  int8_t endpoint(IPAddress ip, uint16_t port);
+
+  // addRequest: send a request of the given kind to ip:port
+  template <typename... Args>
+  Error addRequest(IPAddress ip, uint16_t port, uint8_t kind, uint8_t serverID, uint8_t functionCode, Args... args) {
+    int8_t ep = endpoint(ip, port);
+    if (ep < 0) return REQUEST_QUEUE_FULL;
+    uint32_t token = nextToken(ep, kind);
+    Error e = CP_clients[ep]->addRequest(token, serverID, functionCode, args...);
+    if (e == SUCCESS) stamp(token);
+    return e;
+  }
+  Error addRequest(IPAddress ip, uint16_t port, uint8_t kind, ModbusMessage msg);
+
+  // setTimeout: set the response timeout for requests to ip:port
+  // Returns false if no client could be bound to the endpoint.
+  bool setTimeout(IPAddress ip, uint16_t port, uint32_t timeout);
+
+  // Token decoding
+  static inline uint8_t endpointOf(uint32_t token) { return (token >> 24) & 0xFF; }
+  static inline uint8_t kindOf(uint32_t token) { return (token >> 16) & 0xFF; }
+  static inline uint16_t seqOf(uint32_t token) { return token & 0xFFFF; }
+
+  // elapsed: milliseconds since the request with this token was sent
+  inline uint32_t elapsed(uint32_t token) {
+    return millis() - CP_ep[endpointOf(token) % CLIENTPOOL_MAX].sent[seqOf(token) % CLIENTPOOL_QUEUE];
+  }
+
+protected:
+  struct Endpoint {
+    IPAddress ip;              // Endpoint address
+    uint16_t port;             // Endpoint port
+    uint16_t seq;              // Sequence number of the last request
+    uint32_t lastUse;          // Time of the last request
+    uint32_t sent[CLIENTPOOL_QUEUE];  // Send times of the requests in the queue, by sequence number
+    bool bound;                // Client is bound to this endpoint
+  };
+  ModbusClientTCPasync *CP_clients[CLIENTPOOL_MAX];
+  Endpoint CP_ep[CLIENTPOOL_MAX];
+
+  // nextToken: count up the sequence number and build the token
+  uint32_t nextToken(int8_t ep, uint8_t kind);
+  // stamp: note the send time of a request. The queue limit keeps the slots of pending requests apart
+  inline void stamp(uint32_t token) {
+    CP_ep[endpointOf(token)].sent[seqOf(token) % CLIENTPOOL_QUEUE] = millis();
+  }
+};
+
+#endif
@@ -0,0 +1,138 @@
+// DHTasync
+// Copyright 2021 by miq1@gmx.de
+
+#include "DHTasync.h"
+#include <math.h>
+
+DHTasync::DHTasync() :
+  D_pin(0xFF),
+  D_cb(nullptr),
+  D_arg(nullptr),
+  D_state(DS_IDLE),
+  D_status(DHT_NOT_READ),
+  D_th { NAN, NAN },
+  D_start(0),
+  D_lastRead(0),
+  D_everRead(false),
+  D_edgeCnt(0) { }
+
+// setup: set GPIO and the callback function
+void DHTasync::setup(uint8_t pin, DHTcallback cb, void *arg) {
+  D_pin = pin;
+  D_cb = cb;
+  D_arg = arg;
+  // The line is idling high
+  pinMode(D_pin, INPUT_PULLUP);
+}
+
+// start: begin a read
+bool DHTasync::start() {
+  if (D_pin == 0xFF || busy()) return false;
+  // Give the sensor time to recover from the last read
+  if (D_everRead && millis() - D_lastRead < DHT_MIN_INTERVAL) {
+    // Too early. update() will start the read when the interval has passed
+    D_state = DS_WAIT;
+    return true;
+  }
+  begin();
+  return true;
+}
+
+// begin: send the start pulse
+void DHTasync::begin() {
+  D_everRead = true;
+  D_lastRead = millis();
+  D_edgeCnt = 0;
+  D_state = DS_START;
+  // Pull the line low to wake up the sensor
+  pinMode(D_pin, OUTPUT);
+  digitalWrite(D_pin, LOW);
+  D_ticker.once_ms(DHT_STARTPULSE, [this]() { release(); });
+}
+
+// release: end the start pulse and have the sensor answer
+void DHTasync::release() {
+  // The Ticker may be late - the timeout counts from here
+  D_start = millis();
+  D_state = DS_READ;
+  attachInterruptArg(digitalPinToInterrupt(D_pin), edgeISR, this, FALLING);
+  pinMode(D_pin, INPUT_PULLUP);
+}
+
+// edgeISR: record the time of a falling edge. Nothing else is done here!
+void IRAM_ATTR DHTasync::edgeISR(void *arg) {
+  DHTasync *d = static_cast<DHTasync *>(arg);
+  if (d->D_edgeCnt < DHT_EDGES) {
+    d->D_edges[d->D_edgeCnt] = micros();
+    d->D_edgeCnt = d->D_edgeCnt + 1;
+  }
+}
+
+// update: check if the running read has finished
+void DHTasync::update() {
+  // Is a read waiting for the sensor to recover?
+  if (D_state == DS_WAIT) {
+    // Yes. Start it when the interval has passed
+    if (millis() - D_lastRead >= DHT_MIN_INTERVAL) {
+      begin();
+    }
+    return;
+  }
+  if (D_state != DS_READ) return;
+  // Got all edges or timed out?
+  if (D_edgeCnt >= DHT_EDGES || millis() - D_start > DHT_TIMEOUT_MS) {
+    finish();
+  }
+}
+
+// finish: decode the frame and report it
+void DHTasync::finish() {
+  detachInterrupt(digitalPinToInterrupt(D_pin));
+  D_th = { NAN, NAN };
+  if (D_edgeCnt < DHT_EDGES) {
+    D_status = DHT_TIMEOUT;
+  } else {
+    // The bits are coded in the time between falling edges:
+    // 50us low + 26us high for a '0', 50us low + 70us high for a '1'
+    uint8_t data[5] = { 0, 0, 0, 0, 0 };
+    for (uint8_t i = 0; i < 40; ++i) {
+      data[i / 8] <<= 1;
+      if (D_edges[i + 2] - D_edges[i + 1] > DHT_BIT_THRESHOLD) {
+        data[i / 8] |= 1;
+      }
+    }
+    // Check sum is the lower byte of the sum of the data bytes
+    if (((data[0] + data[1] + data[2] + data[3]) & 0xFF) != data[4]) {
+      D_status = DHT_CHECKSUM;
+    } else {
+      D_status = DHT_OK;
+      D_th.humidity = ((data[0] << 8) | data[1]) * 0.1;
+      D_th.temperature = (((data[2] & 0x7F) << 8) | data[3]) * 0.1;
+      if (data[2] & 0x80) {
+        D_th.temperature = -D_th.temperature;
+      }
+    }
+  }
+  D_state = DS_IDLE;
+  if (D_cb) D_cb(*this, D_arg);
+}
+
+// getStatusString: readable result of the last read
+const char *DHTasync::getStatusString() const {
+  switch (D_status) {
+  case DHT_OK:       return "OK";
+  case DHT_NOT_READ: return "NOT_READ";
+  case DHT_TIMEOUT:  return "TIMEOUT";
+  case DHT_CHECKSUM: return "CHECKSUM";
+  }
+  return "UNKNOWN";
+}
+
+// computeDewPoint: Magnus formula with the Sonntag (1990) constants
+float DHTasync::computeDewPoint(float temperature, float humidity) {
+  if (isnan(temperature) || isnan(humidity) || humidity <= 0.0) return NAN;
+  const float a(17.62);
+  const float b(243.12);
+  float gamma = log(humidity / 100.0) + (a * temperature) / (b + temperature);
+  return (b * gamma) / (a - gamma);
+}
@@ -0,0 +1,90 @@
+// DHTasync
+// Copyright 2021 by miq1@gmx.de
+//
+// DHTasync reads a DHT22/AM2302 sensor without blocking.
+// start() pulls the data line low, a Ticker releases it again after DHT_STARTPULSE ms.
+// A read requested less than DHT_MIN_INTERVAL after the last one is held back by update() until then.
+// The sensor's answer is captured by a FALLING edge interrupt that only records
+// the edge times. update() - to be called frequently - decodes the 40-bit frame
+// when it is complete or the read has timed out, and calls the callback function.
+// Interrupts are never disabled, so WiFi and Modbus will not be disturbed by a read.
+
+#ifndef _DHTASYNC_H
+#define _DHTASYNC_H
+
+#include <Arduino.h>
+#include <Ticker.h>
+
+// Measured values
+struct TempAndHumidity {
+  float temperature;
+  float humidity;
+};
+
+// Result of the last read
+enum DHTstatus : uint8_t { DHT_OK = 0, DHT_NOT_READ, DHT_TIMEOUT, DHT_CHECKSUM };
+
+// Timing values
+const uint32_t DHT_STARTPULSE(2);     // ms to hold the line low to wake up the sensor
+const uint32_t DHT_TIMEOUT_MS(20);    // ms after the release of the start pulse to give up waiting for the frame
+const uint32_t DHT_MIN_INTERVAL(2000); // ms the DHT22 needs between two reads
+const uint32_t DHT_BIT_THRESHOLD(100); // us between falling edges: below is a '0', above is a '1'
+// Number of falling edges in a frame: response start, first bit start and the end of 40 bits
+const uint8_t DHT_EDGES(42);
+
+class DHTasync {
+public:
+  // Callback function type, called by update() after a read has finished, successful or not
+  typedef void (*DHTcallback)(DHTasync& dht, void *arg);
+
+  DHTasync();
+
+  // setup: set GPIO and the callback function with an argument to be handed over to it
+  void setup(uint8_t pin, DHTcallback cb = nullptr, void *arg = nullptr);
+
+  // start: begin a read. If the last one is less than DHT_MIN_INTERVAL ago, the read is
+  // started by update() when the interval has passed. Returns false if a read is waiting or running already.
+  bool start();
+
+  // update: check if the running read has finished. Needs to be called frequently!
+  void update();
+
+  // busy: true while a read is waiting or running
+  inline bool busy() const { return D_state != DS_IDLE; }
+
+  // getTempAndHumidity: values of the last read. NAN if it failed.
+  inline TempAndHumidity getTempAndHumidity() const { return D_th; }
+
+  // getStatus: result of the last read
+  inline DHTstatus getStatus() const { return D_status; }
+  const char *getStatusString() const;
+
+  // computeDewPoint: dew point in degrees Celsius (Magnus formula)
+  static float computeDewPoint(float temperature, float humidity);
+
+protected:
+  enum DHTstate : uint8_t { DS_IDLE = 0, DS_WAIT, DS_START, DS_READ };
+  uint8_t D_pin;                       // GPIO of the data line
+  DHTcallback D_cb;                    // Function to call after a read
+  void *D_arg;                         // Argument to hand over to D_cb
+  volatile DHTstate D_state;           // Running read phase
+  DHTstatus D_status;                  // Result of the last read
+  TempAndHumidity D_th;                // Values of the last read
+  uint32_t D_start;                    // millis() at the release of the start pulse
+  uint32_t D_lastRead;                 // millis() at the start of the last read
+  bool D_everRead;                     // false until the first read was started
+  volatile uint8_t D_edgeCnt;          // Number of falling edges recorded
+  uint32_t D_edges[DHT_EDGES];         // micros() at the falling edges
+  Ticker D_ticker;                     // Timer to end the start pulse
+
+  // begin: send the start pulse
+  void begin();
+  // release: end the start pulse and wait for the answer
+  void release();
+  // finish: stop the interrupt, decode the frame and call the callback
+  void finish();
+  // Interrupt handler
+  static void IRAM_ATTR edgeISR(void *arg);
+};
+
+#endif
@@ -0,0 +1,178 @@
+// HistoryLog
+// Copyright 2021 by miq1@gmx.de
+
+#include "HistoryLog.h"
+
+HistoryLog::HistoryLog(const char *fileName, uint16_t limit, uint32_t retention) :
+  HL_fileName(fileName),
+  HL_limit(limit),
+  HL_retention(retention),
+  HL_pending(0),
+  HL_records(0),
+  HL_newest(0),
+  HL_damaged(false) { }
+
+// load: read the log and call onEntry for all records within the retention time
+uint16_t HistoryLog::load(HLonEntry onEntry) {
+  HistoryEntry recs[HL_BATCH];
+  uint16_t passed = 0;
+
+  HL_records = 0;
+  HL_damaged = false;
+  if (!LittleFS.exists(HL_fileName)) return 0;
+  File f = LittleFS.open(HL_fileName, "r");
+  if (!f) return 0;
+
+  // First pass: find the valid blocks and the newest record
+  uint8_t n;
+  size_t valid = 0;
+  while ((n = readBlock(f, recs))) {
+    for (uint8_t i = 0; i < n; i++) {
+      if (recs[i].stamp > HL_newest) HL_newest = recs[i].stamp;
+    }
+    HL_records += n;
+    valid = f.position();
+  }
+  // Anything behind the last valid block is garbage that would hide the blocks appended later
+  HL_damaged = (f.size() > valid);
+
+  // Second pass: hand out the records within the retention time
+  uint32_t oldest = (HL_newest > HL_retention) ? HL_newest - HL_retention : 0;
+  uint16_t toRead = HL_records;
+  f.seek(0);
+  while (toRead && (n = readBlock(f, recs))) {
+    for (uint8_t i = 0; i < n; i++) {
+      if (recs[i].stamp >= oldest) {
+        onEntry(recs[i]);
+        passed++;
+      }
+    }
+    toRead = (n < toRead) ? toRead - n : 0;
+  }
+  f.close();
+  return passed;
+}
+
+// append: add the entry of a completed slot
+void HistoryLog::append(const HistoryEntry& entry) {
+  // Without a valid time the slot could not be placed again
+  if (entry.stamp < HL_MINTIME) return;
+  HL_buffer[HL_pending++] = entry;
+  if (entry.stamp > HL_newest) HL_newest = entry.stamp;
+  // Block complete?
+  if (HL_pending >= HL_BATCH) {
+    // Yes, write it
+    flush();
+  }
+}
+
+// flush: write the waiting records now
+bool HistoryLog::flush() {
+  if (!HL_pending) return true;
+  // Will the file be full or is it damaged?
+  if (HL_damaged || HL_records + HL_pending > HL_limit) {
+    // Yes. Make room first. Blocks behind a damaged tail would never be read again, so leave it then.
+    if (!compact() && HL_damaged) {
+      HL_pending = 0;
+      return false;
+    }
+  }
+  bool rc = false;
+  File f = LittleFS.open(HL_fileName, "a");
+  if (f) {
+    rc = writeBlock(f, HL_buffer, HL_pending);
+    f.close();
+  }
+  if (rc) {
+    HL_records += HL_pending;
+  } else {
+    // A partly written block has to go with the next compaction
+    HL_damaged = true;
+  }
+  HL_pending = 0;
+  return rc;
+}
+
+// readBlock: read the next block
+uint8_t HistoryLog::readBlock(File& f, HistoryEntry *recs) {
+  BlockHeader hdr;
+  uint16_t crc;
+
+  if (f.read((uint8_t *)&hdr, sizeof(hdr)) != sizeof(hdr)) return 0;
+  if (hdr.magic != HL_MAGIC || hdr.version != HL_VERSION || hdr.count == 0 || hdr.count > HL_BATCH) return 0;
+  size_t len = hdr.count * sizeof(HistoryEntry);
+  if (f.read((uint8_t *)recs, len) != len) return 0;
+  if (f.read((uint8_t *)&crc, sizeof(crc)) != sizeof(crc)) return 0;
+  if (crc != crc16((uint8_t *)recs, len, crc16((uint8_t *)&hdr, sizeof(hdr)))) return 0;
+  return hdr.count;
+}
+
+// writeBlock: append a block with count records
+bool HistoryLog::writeBlock(File& f, const HistoryEntry *recs, uint8_t count) {
+  BlockHeader hdr;
+  hdr.magic = HL_MAGIC;
+  hdr.version = HL_VERSION;
+  hdr.count = count;
+  size_t len = count * sizeof(HistoryEntry);
+  uint16_t crc = crc16((const uint8_t *)recs, len, crc16((uint8_t *)&hdr, sizeof(hdr)));
+
+  if (f.write((const uint8_t *)&hdr, sizeof(hdr)) != sizeof(hdr)) return false;
+  if (f.write((const uint8_t *)recs, len) != len) return false;
+  return f.write((const uint8_t *)&crc, sizeof(crc)) == sizeof(crc);
+}
+
+// compact: rewrite the file with the records within the retention time only
+bool HistoryLog::compact() {
+  HistoryEntry in[HL_BATCH];
+  HistoryEntry out[HL_BATCH];
+  uint8_t outCnt = 0;
+  uint16_t kept = 0;
+  bool rc = true;
+
+  File t = LittleFS.open(HL_TEMPFILE, "w");
+  if (!t) return false;
+  File f = LittleFS.open(HL_fileName, "r");
+  if (f) {
+    uint32_t oldest = (HL_newest > HL_retention) ? HL_newest - HL_retention : 0;
+    uint8_t n;
+    // Copy the valid blocks' records still wanted, in full blocks again
+    while (rc && (n = readBlock(f, in))) {
+      for (uint8_t i = 0; i < n; i++) {
+        if (in[i].stamp < oldest) continue;
+        out[outCnt++] = in[i];
+        if (outCnt == HL_BATCH) {
+          rc = writeBlock(t, out, outCnt);
+          kept += outCnt;
+          outCnt = 0;
+        }
+      }
+    }
+    f.close();
+    if (rc && outCnt) {
+      rc = writeBlock(t, out, outCnt);
+      kept += outCnt;
+    }
+  }
+  t.close();
+  // Could not write the new file completely? Then keep the old one.
+  if (!rc) {
+    LittleFS.remove(HL_TEMPFILE);
+    return false;
+  }
+  LittleFS.remove(HL_fileName);
+  if (!LittleFS.rename(HL_TEMPFILE, HL_fileName)) return false;
+  HL_records = kept;
+  HL_damaged = false;
+  return true;
+}
+
+// crc16: Modbus style CRC over len bytes
+uint16_t HistoryLog::crc16(const uint8_t *data, size_t len, uint16_t crc) {
+  while (len--) {
+    crc ^= *data++;
+    for (uint8_t i = 0; i < 8; i++) {
+      crc = (crc & 1) ? (crc >> 1) ^ 0xA001 : crc >> 1;
+    }
+  }
+  return crc;
+}
@@ -0,0 +1,91 @@
+// HistoryLog
+// Copyright 2021 by miq1@gmx.de
+//
+// HistoryLog keeps completed history slots in an append-only file on LittleFS, so they survive a restart.
+// Each record is the entry of a slot, stamped with the slot's start time. Records are collected in RAM and
+// appended in blocks of up to HL_BATCH records, so the flash is written once per block only.
+// Every block carries a header and a CRC16. A block cut short by a power loss fails the check
+// and is dropped, together with everything behind it, at the next load.
+// Once the file would hold more records than its limit, it is compacted: the records within the
+// retention time are copied to a new file that replaces the old one.
+
+#ifndef _HISTORYLOG_H
+#define _HISTORYLOG_H
+
+#include <Arduino.h>
+#include <LittleFS.h>
+
+#define HL_BATCH 5                     // Records collected before a block is written
+#define HL_MAGIC 0x4844                // Block header mark
+#define HL_VERSION 2                   // Layout version of blocks and records
+#define HL_MINTIME 1609459200          // 2021-01-01: earlier slot times mean the clock was not set yet
+#define HL_TEMPFILE "/history.tmp"     // Scratch file for the compaction
+
+// Values kept in a history entry
+enum HistoryValue : uint8_t { HV_TEMP0 = 0, HV_HUM0, HV_TEMP1, HV_HUM1, HV_COUNT };
+
+// History entry: the samples taken in a slot, an hour or a day.
+// Temperatures t are encoded as uint16_t((t + 100.0) * 10.0), humidities h as uint16_t(h * 10.0).
+// Minima and maxima are 0 if there was no valid sample.
+struct HistoryEntry {
+  uint32_t stamp;                      // Start time of the period, 0 for an empty entry
+  uint16_t count;                      // Number of samples
+  uint8_t on;                          // Target ON state as: (samples(ON) * 100) / samples
+  uint16_t avg[HV_COUNT];              // Averages
+  uint16_t low[HV_COUNT];              // Minima
+  uint16_t high[HV_COUNT];             // Maxima
+};
+
+// Callback for the entries read by load()
+typedef void (*HLonEntry)(const HistoryEntry& entry);
+
+class HistoryLog {
+public:
+  // - fileName: log file on LittleFS
+  // - limit: number of records in the file that will trigger a compaction
+  // - retention: seconds a record is kept, counted back from the newest one
+  HistoryLog(const char *fileName, uint16_t limit, uint32_t retention);
+
+  // load: read the log and call onEntry for all entries within the retention time, oldest first.
+  // Returns the number of entries passed to onEntry.
+  uint16_t load(HLonEntry onEntry);
+
+  // append: add the entry of a completed slot. Entries are written in blocks of HL_BATCH.
+  void append(const HistoryEntry& entry);
+
+  // flush: write the waiting records now, f.i. before a restart.
+  // Returns false if the file could not be written; the waiting records are lost then.
+  bool flush();
+
+  // setLimit: change the number of records that will trigger a compaction
+  inline void setLimit(uint16_t limit) { HL_limit = limit; }
+
+  inline uint8_t pending() { return HL_pending; }
+  inline uint16_t records() { return HL_records; }
+
+protected:
+  struct BlockHeader {
+    uint16_t magic;                    // HL_MAGIC
+    uint8_t version;                   // HL_VERSION
+    uint8_t count;                     // Records following, 1..HL_BATCH. A CRC16 of header and records comes last.
+  };
+  const char *HL_fileName;             // Log file
+  uint16_t HL_limit;                   // Records before a compaction
+  uint32_t HL_retention;               // Seconds a record is kept
+  HistoryEntry HL_buffer[HL_BATCH];    // Records waiting to be written
+  uint8_t HL_pending;                  // Number of records waiting
+  uint16_t HL_records;                 // Valid records in the file
+  uint32_t HL_newest;                  // Latest slot time seen
+  bool HL_damaged;                     // File has an invalid tail and must be rewritten before the next append
+
+  // readBlock: read the next block. Returns the number of records read, 0 at the end or for an invalid block
+  uint8_t readBlock(File& f, HistoryEntry *recs);
+  // writeBlock: append a block with count records
+  bool writeBlock(File& f, const HistoryEntry *recs, uint8_t count);
+  // compact: rewrite the file with the records within the retention time only
+  bool compact();
+  // crc16: Modbus style CRC over len bytes
+  static uint16_t crc16(const uint8_t *data, size_t len, uint16_t crc = 0xFFFF);
+};
+
+#endif
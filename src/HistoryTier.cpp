@@ -0,0 +1,120 @@
+// HistoryTier
+// Copyright 2021 by miq1@gmx.de
+
+#include "HistoryTier.h"
+
+HistoryTier::HistoryTier(const char *fileName, uint32_t period, uint16_t size) :
+  HT_fileName(fileName),
+  HT_period(period),
+  HT_size(size) {
+  memset(&HT_running, 0, sizeof(HT_running));
+}
+
+// begin: create the ring file, if it is missing or has a wrong size
+bool HistoryTier::begin() {
+  if (LittleFS.exists(HT_fileName)) {
+    File f = LittleFS.open(HT_fileName, "r");
+    if (f && f.size() == HT_size * sizeof(HistoryEntry)) {
+      f.close();
+      return true;
+    }
+    if (f) f.close();
+  }
+  // Fill a new file with empty entries
+  File f = LittleFS.open(HT_fileName, "w");
+  if (!f) return false;
+  HistoryEntry empty;
+  memset(&empty, 0, sizeof(empty));
+  bool rc = true;
+  for (uint16_t i = 0; rc && i < HT_size; i++) {
+    rc = (f.write((const uint8_t *)&empty, sizeof(empty)) == sizeof(empty));
+  }
+  f.close();
+  return rc;
+}
+
+// add: merge a completed entry of the finer level into the running period
+bool HistoryTier::add(const HistoryEntry& entry, HistoryEntry& done) {
+  bool closed = false;
+  uint32_t start = periodStart(entry.stamp);
+
+  // Has a new period begun?
+  if (HT_running.stamp && HT_running.stamp != start) {
+    // Yes. Save the previous one and hand it out
+    write(HT_running);
+    done = HT_running;
+    closed = true;
+    HT_running.stamp = 0;
+  }
+  // Need to start a period?
+  if (!HT_running.stamp) {
+    // Yes. Take up the one saved before a restart, if it is this one, else begin with an empty entry
+    if (!read(index(start), 1, &HT_running) || HT_running.stamp != start) {
+      memset(&HT_running, 0, sizeof(HT_running));
+      HT_running.stamp = start;
+    }
+  }
+  merge(HT_running, entry);
+  return closed;
+}
+
+// save: write the running period
+bool HistoryTier::save() {
+  if (!HT_running.stamp) return true;
+  return write(HT_running);
+}
+
+// read: get count entries starting at ring position first, the running period included
+uint16_t HistoryTier::read(uint16_t first, uint16_t count, HistoryEntry *entries) {
+  if (first >= HT_size) return 0;
+  if (count > HT_size - first) count = HT_size - first;
+  File f = LittleFS.open(HT_fileName, "r");
+  if (!f) return 0;
+  uint16_t cnt = 0;
+  if (f.seek(first * sizeof(HistoryEntry))) {
+    while (cnt < count && f.read((uint8_t *)&entries[cnt], sizeof(HistoryEntry)) == sizeof(HistoryEntry)) {
+      cnt++;
+    }
+  }
+  f.close();
+  // The running period is more recent than its place in the file
+  if (HT_running.stamp) {
+    uint16_t r = index(HT_running.stamp);
+    if (r >= first && r < first + cnt) {
+      entries[r - first] = HT_running;
+    }
+  }
+  return cnt;
+}
+
+// periodStart: start time of the period holding time t
+uint32_t HistoryTier::periodStart(time_t t) {
+  tm tm;
+  localtime_r(&t, &tm);
+  uint32_t intoDay = tm.tm_hour * 3600 + tm.tm_min * 60 + tm.tm_sec;
+  return t - ((HT_period < 86400) ? intoDay % HT_period : intoDay);
+}
+
+// merge: add the samples of src to dst
+void HistoryTier::merge(HistoryEntry& dst, const HistoryEntry& src) {
+  if (!src.count) return;
+  uint32_t total = dst.count + src.count;
+  for (uint8_t i = 0; i < HV_COUNT; i++) {
+    dst.avg[i] = (dst.avg[i] * dst.count + src.avg[i] * src.count + total / 2) / total;
+    // Minima and maxima of 0 had no valid sample
+    if (src.low[i] && (!dst.low[i] || src.low[i] < dst.low[i])) dst.low[i] = src.low[i];
+    if (src.high[i] > dst.high[i]) dst.high[i] = src.high[i];
+  }
+  dst.on = (dst.on * dst.count + src.on * src.count + total / 2) / total;
+  dst.count = (total > 0xFFFF) ? 0xFFFF : total;
+}
+
+// write: put an entry into its place in the ring file
+bool HistoryTier::write(const HistoryEntry& entry) {
+  File f = LittleFS.open(HT_fileName, "r+");
+  if (!f) return false;
+  bool rc = f.seek(index(entry.stamp) * sizeof(HistoryEntry))
+    && f.write((const uint8_t *)&entry, sizeof(entry)) == sizeof(entry);
+  f.close();
+  return rc;
+}
@@ -0,0 +1,62 @@
+// HistoryTier
+// Copyright 2021 by miq1@gmx.de
+//
+// HistoryTier rolls up history entries into longer periods, f.i. hours or days, and keeps one entry
+// per period in a ring file on LittleFS. The entry of a period has a fixed place in the file,
+// so it can be read and updated in place, without touching the others.
+// Completed entries of the finer level are merged into the running period with add(). The running
+// period is written when the next one begins and with save(). After a restart, a period saved
+// before is taken up again, so only the entries not saved yet are missing.
+// Periods start at local time, so the time zone must be set before the first add().
+
+#ifndef _HISTORYTIER_H
+#define _HISTORYTIER_H
+
+#include <Arduino.h>
+#include <LittleFS.h>
+#include "HistoryLog.h"
+
+class HistoryTier {
+public:
+  // - fileName: ring file on LittleFS
+  // - period: seconds per entry. Must divide a day or be a day
+  // - size: number of entries kept
+  HistoryTier(const char *fileName, uint32_t period, uint16_t size);
+
+  // begin: create the ring file, if it is missing or has a wrong size
+  bool begin();
+
+  // add: merge a completed entry of the finer level into the running period.
+  // Returns true if the entry has started a new period; done then has the previous one.
+  bool add(const HistoryEntry& entry, HistoryEntry& done);
+
+  // save: write the running period
+  bool save();
+
+  // read: get count entries starting at ring position first, the running period included.
+  // Returns the number of entries read.
+  uint16_t read(uint16_t first, uint16_t count, HistoryEntry *entries);
+
+  // periodStart: start time of the period holding time t
+  uint32_t periodStart(time_t t);
+
+  // index: ring position of the period starting at start
+  inline uint16_t index(uint32_t start) { return ((start + HT_period / 2) / HT_period) % HT_size; }
+
+  inline uint16_t size() { return HT_size; }
+  inline uint32_t period() { return HT_period; }
+
+  // merge: add the samples of src to dst
+  static void merge(HistoryEntry& dst, const HistoryEntry& src);
+
+protected:
+  const char *HT_fileName;             // Ring file
+  uint32_t HT_period;                  // Seconds per entry
+  uint16_t HT_size;                    // Number of entries
+  HistoryEntry HT_running;             // Running period, stamp 0 if none
+
+  // write: put an entry into its place in the ring file
+  bool write(const HistoryEntry& entry);
+};
+
+#endif
@@ -18,24 +18,86 @@ using std::lock_guard;
 #define LOCK_GUARD(x, y)
 #endif
 
+#if defined(ESP8266) || defined(ESP32)
 #include <Arduino.h>
+#else
+#include <cstdint>
+#include <cstring>
+#endif
 #include <iterator>
+#include <algorithm>
+#include <type_traits>
+#include <new>
+#include <utility>
+
+// RingBufStorage: memory for RingBuf.
+// N > 0: capacity is fixed at compile time, the buffer is part of the object (no heap!)
+// N == 0: capacity is given at run time, the buffer is allocated on the heap
+template <typename T, size_t N>
+struct RingBufStorage {
+  T RB_buffer[N];                               // The data buffer proper
+  static constexpr size_t RB_len = N;           // Real length of buffer
+  static constexpr size_t RB_usable = N;        // Requested length of the buffer
+};
+
+template <typename T>
+struct RingBufStorage<T, 0> {
+  T *RB_buffer;                                 // The data buffer proper
+  size_t RB_len;                                // Real length of buffer
+  size_t RB_usable;                             // Requested length of the buffer
+};
 
 // RingBuf implements a circular buffer of chosen size.
+// The buffer wraps around: head and tail are moving through the allocated memory, so
+// adding to a full buffer or removing elements will never move any data.
+// RingBuf<T> allocates its buffer on the heap, RingBuf<T, N> has a fixed capacity
+// of N elements stored in the object itself.
 // No exceptions thrown at all. Memory allocation failures will result in a const
-// buffer pointing to the static "nilBuf"!
-// template <typename T>
-template <typename T>
-class RingBuf {
+// buffer pointing to the static "nilBuf"! A RingBuf<T, N> is always valid.
+// T may be any trivially copyable type - scalars as well as plain structs. Elements are
+// moved around with memcpy and compared with memcmp, so structs should have no padding
+// if operator== is to be used on them.
+template <typename T, size_t N = 0>
+class RingBuf : protected RingBufStorage<T, N> {
+  static_assert(std::is_trivially_copyable<T>::value, "RingBuf element type must be trivially copyable");
 public:
 // Fallback static minimal buffer if memory allocation failed etc.
   static const T nilBuf[2];
 
-// Constructor
+// Capacity of a RingBuf<T, N> in elements and bytes, usable in constant expressions (0 for RingBuf<T>)
+  static constexpr size_t fixedSize = N;
+  static constexpr size_t fixedBytes = N * sizeof(T);
+
+// Span: a contiguous part of the used buffer area
+  struct Span {
+    const T *ptr;               // Start of the part
+    size_t len;                 // Number of elements in it
+  };
+
+// Constructor for the heap-allocated variant RingBuf<T>
 // size: required size in T elements
 // preserve: if true, no more elements will be added to a full buffer unless older elements are consumed
 //           if false, buffer will be rotated until the newest element is added
-  explicit RingBuf(size_t size = 256, bool preserve = false) noexcept;
+  template <size_t M = N, typename std::enable_if<M == 0, int>::type = 0>
+  explicit RingBuf(size_t size = 256, bool preserve = false) noexcept :
+    RB_head(0),
+    RB_count(0),
+    RB_preserve(preserve) {
+    this->RB_len = size;
+    this->RB_usable = size;
+    // Allocate memory
+    RB_buffer = new T[RB_len];
+    // Failed?
+    if (!RB_buffer) setFail();
+  }
+
+// Constructor for the fixed size variant RingBuf<T, N>
+// preserve: see above
+  template <size_t M = N, typename std::enable_if<M != 0, int>::type = 0>
+  explicit RingBuf(bool preserve = false) noexcept :
+    RB_head(0),
+    RB_count(0),
+    RB_preserve(preserve) { }
 
   // Destructor: takes care of cleaning up the buffer
   ~RingBuf();
@@ -53,23 +115,42 @@ public:
   RingBuf& operator=(RingBuf &&r);
 
   // size: get number of elements currently in buffer
-  // WARNING! due to the nature of the rolling buffer, this size is VOLATILE and needs to be 
+  // WARNING! due to the nature of the rolling buffer, this size is VOLATILE and needs to be
   //          read again every time the buffer is used! Else data may be missed.
   size_t size();
 
   // data: get start address of the elements in buffer
+  // If the used area has wrapped around the buffer end, it will be rearranged to be contiguous
+  // first. This is costly, so better use the two-span variant below where possible!
   const T *data();
 
+  // data: get the elements in buffer as two spans without moving anything.
+  // first holds the oldest elements, second those wrapped around to the buffer start (may be empty)
+  // returns the number of elements in both spans
+  size_t data(Span& first, Span& second);
+
+  // peek: get a read-only view of count elements, starting at logical index start, without copying.
+  // Like data(), the view is split into two spans if it wraps around the buffer end.
+  // returns the number of elements in both spans, that may be less than count or even 0
+  size_t peek(size_t start, size_t count, Span& first, Span& second);
+
   // empty: returns true if no elements are in the buffer
   bool empty();
 
   // valid: returns true if a buffer was allocated and is usable
   // Using the object in bool context returns the same information
-  bool valid();
+  // For RingBuf<T, N> this is constantly true, so all checks are optimized away.
+  inline bool valid() const {
+    if constexpr (N > 0) {
+      return true;
+    } else {
+      return (RB_buffer && (RB_buffer != RingBuf<T, N>::nilBuf));
+    }
+  }
   operator bool();
 
   // capacity: return number of unused elements in buffer
-  // WARNING! due to the nature of the rolling buffer, this size is VOLATILE and needs to be 
+  // WARNING! due to the nature of the rolling buffer, this size is VOLATILE and needs to be
   //          read again every time the buffer is used! Else data may be missed.
   size_t capacity();
 
@@ -80,12 +161,24 @@ public:
   size_t pop(size_t numElements);
 
   // operator[]: return the element the index is pointing to. If index is
-  // outside the currently used area, return 0
+  // outside the currently used area, return a value-initialized T (0 for scalars)
   const T operator[](size_t index);
 
-  // last: return the last added element or 0, of empty
+  // last: return the last added element or a value-initialized T, if empty
   const T last();
 
+  // at: return a pointer to the element the index is pointing to or nullptr, if index
+  // is outside the currently used area. The pointer is valid until the next modification!
+  const T *at(size_t index);
+
+  // get: copy the element the index is pointing to into target.
+  // Returns false (and leaves target untouched) if index is outside the currently used area.
+  bool get(size_t index, T& target);
+
+  // copyRange: copy up to len elements, starting at logical index start, into target
+  // returns number of elements actually transferred
+  size_t copyRange(T *target, size_t start, size_t len);
+
   // safeCopy: get a stable data copy from currently used buffer
   // target: buffer to copy data into
   // len: number of elements requested
@@ -93,16 +186,22 @@ public:
   // returns number of elements actually transferred
   size_t safeCopy(T *target, size_t tLen, bool move = false);
 
-  // push_back: add a single element or a buffer of elements to the end of the buffer. 
+  // push_back: add a single element or a buffer of elements to the end of the buffer.
   // If there is not enough room, the buffer will be rolled until the added elements will fit.
   bool push_back(const T c);
   bool push_back(const T *data, size_t size);
 
+  // emplace_back: construct a new element in place at the end of the buffer from args.
+  // The same rules as for push_back apply if the buffer is full.
+  template <typename... Args>
+  bool emplace_back(Args&&... args);
+
   // Equality comparison: are sizes and contents of two buffers identical?
   bool operator==(RingBuf &r);
 
   // Iterator: simple forward-only iterator over the visible elements of the buffer
-  struct Iterator 
+  // It is keeping a logical index that is mapped onto the wrapped buffer.
+  struct Iterator
   {
     using iterator_category = std::forward_iterator_tag;
     using difference_type   = std::ptrdiff_t;
@@ -110,258 +209,366 @@ public:
     using pointer           = T*;
     using reference         = T&;
 
-    explicit Iterator(pointer ptr) : m_ptr(ptr) {}
+    Iterator(pointer buffer, size_t len, size_t head, size_t index) :
+      m_buffer(buffer), m_len(len), m_head(head), m_index(index) {}
 
-    reference operator*() const { return *m_ptr; }
-    pointer operator->() { return m_ptr; }
-    Iterator& operator++() { m_ptr++; return *this; }  
+    reference operator*() const { return m_buffer[physical()]; }
+    pointer operator->() { return m_buffer + physical(); }
+    Iterator& operator++() { m_index++; return *this; }
     Iterator operator++(int) { Iterator tmp = *this; ++(*this); return tmp; }
-    friend bool operator== (const Iterator& a, const Iterator& b) { return a.m_ptr == b.m_ptr; };
-    friend bool operator!= (const Iterator& a, const Iterator& b) { return a.m_ptr != b.m_ptr; };  
+    friend bool operator== (const Iterator& a, const Iterator& b) { return a.m_index == b.m_index && a.m_buffer == b.m_buffer; };
+    friend bool operator!= (const Iterator& a, const Iterator& b) { return a.m_index != b.m_index || a.m_buffer != b.m_buffer; };
 
     private:
-      pointer m_ptr;
+      pointer m_buffer;       // Start of the underlying buffer
+      size_t m_len;           // Length of the underlying buffer
+      size_t m_head;          // Buffer index of the first element
+      size_t m_index;         // Logical index of the element pointed to
+      // physical: map logical index to buffer index
+      inline size_t physical() const {
+        size_t inx = m_head + m_index;
+        return (inx >= m_len) ? inx - m_len : inx;
+      }
   };
 
   // Provide begin() and end()
-  Iterator begin() { return Iterator(RB_begin); }
-  Iterator end()   { return Iterator(RB_end); }
+  Iterator begin() { return Iterator(RB_buffer, RB_len, RB_head, 0); }
+  Iterator end()   { return Iterator(RB_buffer, RB_len, RB_head, RB_count); }
 
-  // bufferAdr: return the start address of the underlying, double-sized data buffer.
+  // bufferAdr: return the start address of the underlying data buffer.
   // bufferSize: return the real length of the underlying data buffer.
   // Note that this is only sensible in a debug context!
   inline const uint8_t *bufferAdr() { return (uint8_t *)RB_buffer; }
   inline size_t bufferSize() { return RB_len * RB_elementSize; }
 
 protected:
-  T *RB_buffer;           // The data buffer proper (twice the requested size)
-  T *RB_begin;            // Pointer to the first element currently used
-  T *RB_end;              // Pointer behind the last element currently used
-  size_t RB_len;                // Real length of buffer (twice the requested size)
-  size_t RB_usable;             // Requested length of the buffer
+  using RingBufStorage<T, N>::RB_buffer;
+  using RingBufStorage<T, N>::RB_len;
+  using RingBufStorage<T, N>::RB_usable;
+  size_t RB_head;               // Buffer index of the first element currently used
+  size_t RB_count;              // Number of elements currently used
   bool RB_preserve;             // Flag to hold or discard the oldest elements if elements are added
-  size_t RB_elementSize;        // Size of a single buffer element
+  static constexpr size_t RB_elementSize = sizeof(T);   // Size of a single buffer element
 #if USE_MUTEX
   std::mutex m;              // Mutex to protect pop, clear and push_back operations
 #endif
   void setFail();            // Internal function to set the object to nilBuf
-  void moveFront(size_t numElements); // Move buffer far left internally
+  // wrap: map a logical index (0 = first element) to the buffer index (used internally only)
+  inline size_t wrap(size_t index) const {
+    size_t inx = RB_head + index;
+    return (inx >= RB_len) ? inx - RB_len : inx;
+  }
+  void copyOut(T *target, size_t start, size_t len) const; // Copy elements out, taking care of wrap-around
+  T *slot();                 // Get the buffer slot for a new element, rolling the buffer if needed
 };
 
-template <typename T>
-const T  RingBuf<T>::nilBuf[2] = { 0, 0 };
-
-// setFail: in case of memory allocation problems, use static nilBuf 
-template <typename T>
-void RingBuf<T>::setFail() {
-  RB_buffer = (T *)RingBuf<T>::nilBuf;
-  RB_len = 2 * RB_elementSize;
-  RB_usable = 0;
-  RB_begin = RB_end = RB_buffer;
-}
-
-// valid: return if buffer is a real one
-template <typename T>
-bool RingBuf<T>::valid() {
-  return (RB_buffer && (RB_buffer != RingBuf<T>::nilBuf));
+template <typename T, size_t N>
+const T  RingBuf<T, N>::nilBuf[2] = { };
+
+// setFail: in case of memory allocation problems, use static nilBuf
+// (RingBuf<T> only)
+template <typename T, size_t N>
+void RingBuf<T, N>::setFail() {
+  static_assert(N == 0, "RingBuf<T, N> cannot fail");
+  RB_buffer = (T *)RingBuf<T, N>::nilBuf;
+  this->RB_len = 2;
+  this->RB_usable = 0;
+  RB_head = RB_count = 0;
 }
 
 // operator bool: same as valid()
-template <typename T>
-RingBuf<T>::operator bool() {
+template <typename T, size_t N>
+RingBuf<T, N>::operator bool() {
   return valid();
 }
 
-// Constructor: allocate a buffer twice the requested size
-template <typename T>
-RingBuf<T>::RingBuf(size_t size, bool p) noexcept :
-  RB_len(size),
-  RB_usable(size),
-  RB_preserve(p),
-  RB_elementSize(sizeof(T)) {
-  // Allocate memory
-  RB_buffer = new T[RB_len];
-  // Failed?
-  if (!RB_buffer) setFail();
-  else clear();
-}
-
 // Destructor: free allocated memory, if any
-template <typename T>
-RingBuf<T>::~RingBuf() {
-  // Do we have a valid buffer?
-  if (valid()) {
-    // Yes, free it
-    delete RB_buffer;
+template <typename T, size_t N>
+RingBuf<T, N>::~RingBuf() {
+  if constexpr (N == 0) {
+    // Do we have a valid buffer?
+    if (valid()) {
+      // Yes, free it
+      delete[] RB_buffer;
+    }
   }
 }
 
 // Copy constructor: take over everything
-template <typename T>
-RingBuf<T>::RingBuf(const RingBuf &r) noexcept {
-  // Is the assigned RingBuf valid?
-  if (r.RB_buffer && (r.RB_buffer != RingBuf<T>::nilBuf)) {
-    // Yes. Try to allocate a copy
-    RB_buffer = new T[r.RB_len];
-    // Succeeded?
-    if (RB_buffer) {
-      // Yes. copy over data
-      RB_len = r.RB_len;
-      memcpy(RB_buffer, r.RB_buffer, RB_len * r.RB_elementSize);
-      RB_begin = RB_buffer + (r.RB_begin - r.RB_buffer);
-      RB_end = RB_buffer + (r.RB_end - r.RB_buffer);
-      RB_preserve = r.RB_preserve;
-      RB_usable = r.RB_usable;
-      RB_elementSize = r.RB_elementSize;
+template <typename T, size_t N>
+RingBuf<T, N>::RingBuf(const RingBuf &r) noexcept :
+  RB_head(r.RB_head),
+  RB_count(r.RB_count),
+  RB_preserve(r.RB_preserve) {
+  if constexpr (N == 0) {
+    // Is the assigned RingBuf valid?
+    if (r.RB_buffer && (r.RB_buffer != RingBuf<T, N>::nilBuf)) {
+      // Yes. Try to allocate a copy
+      RB_buffer = new T[r.RB_len];
+      // Succeeded?
+      if (RB_buffer) {
+        // Yes. copy over data
+        this->RB_len = r.RB_len;
+        this->RB_usable = r.RB_usable;
+        memcpy(RB_buffer, r.RB_buffer, RB_len * RB_elementSize);
+      } else {
+        setFail();
+      }
     } else {
       setFail();
     }
   } else {
-    setFail();
+    // Fixed size buffers are always valid - just copy the data
+    memcpy(RB_buffer, r.RB_buffer, RB_len * RB_elementSize);
   }
 }
 
 // Move constructor
-template <typename T>
-RingBuf<T>::RingBuf(RingBuf &&r) {
-  // Is the assigned RingBuf valid?
-  if (r.RB_buffer && (r.RB_buffer != RingBuf<T>::nilBuf)) {
-    // Yes. Take over the data
-    RB_buffer = r.RB_buffer;
-    RB_len = r.RB_len;
-    RB_begin = RB_buffer + (r.RB_begin - r.RB_buffer);
-    RB_end = RB_buffer + (r.RB_end - r.RB_buffer);
-    RB_preserve = r.RB_preserve;
-    RB_usable = r.RB_usable;
-    RB_elementSize = r.RB_elementSize;
-    r.RB_buffer = nullptr;
+template <typename T, size_t N>
+RingBuf<T, N>::RingBuf(RingBuf &&r) :
+  RB_head(r.RB_head),
+  RB_count(r.RB_count),
+  RB_preserve(r.RB_preserve) {
+  if constexpr (N == 0) {
+    // Is the assigned RingBuf valid?
+    if (r.RB_buffer && (r.RB_buffer != RingBuf<T, N>::nilBuf)) {
+      // Yes. Take over the data
+      RB_buffer = r.RB_buffer;
+      this->RB_len = r.RB_len;
+      this->RB_usable = r.RB_usable;
+      // The source is left with the nilBuf
+      r.setFail();
+    } else {
+      setFail();
+    }
   } else {
-    setFail();
+    // There is no buffer to take over for fixed size buffers, so copy the data
+    memcpy(RB_buffer, r.RB_buffer, RB_len * RB_elementSize);
+    r.RB_head = r.RB_count = 0;
   }
 }
 
 // Assignment
-template <typename T>
-RingBuf<T>& RingBuf<T>::operator=(const RingBuf<T> &r) {
-  if (valid()) {
+template <typename T, size_t N>
+RingBuf<T, N>& RingBuf<T, N>::operator=(const RingBuf<T, N> &r) {
+  if (valid() && this != &r) {
     // Is the source a real RingBuf?
-    if (r.RB_buffer && (r.RB_buffer != RingBuf<T>::nilBuf)) {
+    if (r.valid()) {
       // Yes. Copy over the data
-      clear();
-      push_back(r.RB_begin, r.RB_end - r.RB_begin);
+      LOCK_GUARD(cLock, m);
+      size_t n = r.RB_count;
+      // Does it fit?
+      if (n > RB_usable) {
+        // No. Keep the newest elements only - or none at all, if we are to preserve
+        n = RB_preserve ? 0 : RB_usable;
+      }
+      r.copyOut(RB_buffer, r.RB_count - n, n);
+      RB_head = 0;
+      RB_count = n;
     }
   }
   return *this;
 }
 
 // Move assignment
-template <typename T>
-RingBuf<T>& RingBuf<T>::operator=(RingBuf<T> &&r) {
-  if (valid()) {
+template <typename T, size_t N>
+RingBuf<T, N>& RingBuf<T, N>::operator=(RingBuf<T, N> &&r) {
+  if (valid() && this != &r) {
     // Is the source a real RingBuf?
-    if (r.RB_buffer && (r.RB_buffer != RingBuf<T>::nilBuf)) {
+    if (r.valid()) {
       // Yes. Copy over the data
-      clear();
-      push_back(r.RB_begin, r.RB_end - r.RB_begin);
-      r.RB_buffer = nullptr;
+      *this = static_cast<const RingBuf<T, N>&>(r);
+      if constexpr (N == 0) {
+        // Release the source buffer
+        delete[] r.RB_buffer;
+        r.setFail();
+      } else {
+        r.clear();
+      }
     }
   }
   return *this;
 }
 
 // size: number of elements used in the buffer
-template <typename T>
-size_t RingBuf<T>::size() {
-  return RB_end - RB_begin;
+template <typename T, size_t N>
+size_t RingBuf<T, N>::size() {
+  return RB_count;
 }
 
 // data: get start of used data area
-template <typename T>
-const T *RingBuf<T>::data() {
-  return RB_begin;
+// Wrapped contents are rotated to the buffer start to make them contiguous
+template <typename T, size_t N>
+const T *RingBuf<T, N>::data() {
+  if (valid()) {
+    LOCK_GUARD(cLock, m);
+    // Is the used area split?
+    if (RB_head + RB_count > RB_len) {
+      // Yes. Rotate the buffer to have the first element at index 0
+      std::rotate(RB_buffer, RB_buffer + RB_head, RB_buffer + RB_len);
+      RB_head = 0;
+    }
+  }
+  return RB_buffer + RB_head;
+}
+
+// data: get used data area as two spans
+template <typename T, size_t N>
+size_t RingBuf<T, N>::data(Span& first, Span& second) {
+  LOCK_GUARD(cLock, m);
+  first.ptr = RB_buffer + RB_head;
+  second.ptr = RB_buffer;
+  // Does the used area wrap around the buffer end?
+  if (RB_head + RB_count > RB_len) {
+    // Yes. Split it
+    first.len = RB_len - RB_head;
+    second.len = RB_count - first.len;
+  } else {
+    // No, all is in the first part
+    first.len = RB_count;
+    second.len = 0;
+  }
+  return RB_count;
+}
+
+// peek: get view of a part of the used data area as two spans
+template <typename T, size_t N>
+size_t RingBuf<T, N>::peek(size_t start, size_t count, Span& first, Span& second) {
+  LOCK_GUARD(cLock, m);
+  // Limit the view to the used area
+  if (start >= RB_count) {
+    count = 0;
+  } else if (count > RB_count - start) {
+    count = RB_count - start;
+  }
+  size_t from = wrap(start);
+  first.ptr = RB_buffer + from;
+  second.ptr = RB_buffer;
+  // Does the view wrap around the buffer end?
+  if (from + count > RB_len) {
+    // Yes. Split it
+    first.len = RB_len - from;
+    second.len = count - first.len;
+  } else {
+    // No, all is in the first part
+    first.len = count;
+    second.len = 0;
+  }
+  return count;
 }
 
 // empty: is any data in buffer?
-template <typename T>
-bool RingBuf<T>::empty() {
+template <typename T, size_t N>
+bool RingBuf<T, N>::empty() {
   return ((size() == 0) || !valid());
 }
 
 // capacity: return remaining usable size
-template <typename T>
-size_t RingBuf<T>::capacity() {
+template <typename T, size_t N>
+size_t RingBuf<T, N>::capacity() {
   if (!valid()) return 0;
   return RB_usable - size();
 }
 
 // clear: forget about contents
-template <typename T>
-bool RingBuf<T>::clear() {
+template <typename T, size_t N>
+bool RingBuf<T, N>::clear() {
   if (!valid()) return false;
   LOCK_GUARD(cLock, m);
-  RB_begin = RB_end = RB_buffer;
+  RB_head = RB_count = 0;
   return true;
 }
 
 // pop: remove elements from the beginning of the buffer
-template <typename T>
-size_t RingBuf<T>::pop(size_t numElements) {
+template <typename T, size_t N>
+size_t RingBuf<T, N>::pop(size_t numElements) {
   if (!valid()) return 0;
-  // Do we have data in the buffer?
-  if (size()) {
-    // Yes. Is the requested number of elements larger than the used buffer?
-    if (numElements >= size()) {
-      // Yes. clear the buffer
-      size_t n = size();
-      clear();
-      return n;
-    } else {
-      LOCK_GUARD(cLock, m);
-      // No, the buffer needs to be emptied partly only
-      moveFront(numElements);
-    }
-    return numElements;
+  LOCK_GUARD(cLock, m);
+  // Is the requested number of elements larger than the used buffer?
+  if (numElements >= RB_count) {
+    // Yes. clear the buffer
+    numElements = RB_count;
+    RB_head = RB_count = 0;
+  } else {
+    // No, just advance the head
+    RB_head = wrap(numElements);
+    RB_count -= numElements;
   }
-  return 0;
+  return numElements;
 }
 
-// moveFront: shift left buffer contents by a given number of elements.
-// (used internally only)
-template <typename T>
-void RingBuf<T>::moveFront(size_t numElements) {
-  RB_begin += numElements;
-  memmove(RB_buffer, RB_begin, (RB_end - RB_begin) * RB_elementSize);
-  RB_begin = RB_buffer;
-  RB_end -= numElements;
+// copyOut: copy len elements, starting at logical index start, into target
+// (used internally only - caller has to make sure the range is valid)
+template <typename T, size_t N>
+void RingBuf<T, N>::copyOut(T *target, size_t start, size_t len) const {
+  if (!len) return;
+  size_t from = wrap(start);
+  // Will we hit the buffer end?
+  size_t part = RB_len - from;
+  if (part >= len) {
+    // No, we can copy in one go
+    memcpy(target, RB_buffer + from, len * RB_elementSize);
+  } else {
+    // Yes. Copy up to the buffer end first, then the rest from the buffer start
+    memcpy(target, RB_buffer + from, part * RB_elementSize);
+    memcpy(target + part, RB_buffer, (len - part) * RB_elementSize);
+  }
+}
+
+// slot: make room for one more element and return its buffer address
+// Returns nullptr if the buffer is full and the oldest elements are to be preserved.
+// (used internally only - caller has to hold the lock)
+template <typename T, size_t N>
+T *RingBuf<T, N>::slot() {
+  // No more space?
+  if (RB_count == RB_usable) {
+    // No, we need to drop something
+    // Are we to keep the oldest data?
+    if (RB_preserve) {
+      // Yes. The new element will be dropped to leave the buffer untouched
+      return nullptr;
+    }
+    // We need to drop the oldest element head is pointing to
+    RB_head = wrap(1);
+    RB_count--;
+  }
+  T *cp = RB_buffer + wrap(RB_count);
+  RB_count++;
+  return cp;
 }
 
 // push_back(single element): add one element to the buffer, potentially discarding previous ones
-template <typename T>
-bool RingBuf<T>::push_back(const T c) {
+template <typename T, size_t N>
+bool RingBuf<T, N>::push_back(const T c) {
   if (!valid()) return false;
   {
     LOCK_GUARD(cLock, m);
-    // No more space?
-    if (capacity() == 0) {
-      // No, we need to drop something
-      // Are we to keep the oldest data?
-      if (RB_preserve) {
-        // Yes. The new element will be dropped to leave the buffer untouched
-        return false;
-      }
-      // We need to drop the oldest element begin is pointing to
-      moveFront(1);
-    }
+    T *cp = slot();
+    if (!cp) return false;
     // Now add the element
-    *RB_end = c;
-    RB_end++;
+    *cp = c;
+  }
+  return true;
+}
+
+// emplace_back: construct an element in its buffer slot, potentially discarding previous ones
+template <typename T, size_t N>
+template <typename... Args>
+bool RingBuf<T, N>::emplace_back(Args&&... args) {
+  if (!valid()) return false;
+  {
+    LOCK_GUARD(cLock, m);
+    T *cp = slot();
+    if (!cp) return false;
+    // T is trivially copyable, so the old slot contents need no destruction
+    new (cp) T { std::forward<Args>(args)... };
   }
   return true;
 }
 
 // push_back(element buffer): add a batch of elements to the buffer
-template <typename T>
-bool RingBuf<T>::push_back(const T *data, size_t size) {
+template <typename T, size_t N>
+bool RingBuf<T, N>::push_back(const T *data, size_t size) {
   if (!valid()) return false;
   // Do not process nullptr or zero lengths
   if (!data || size == 0) return false;
@@ -370,7 +577,7 @@ bool RingBuf<T>::push_back(const T *data, size_t size) {
   {
     LOCK_GUARD(cLock, m);
     // Is the size to be added fitting the capacity?
-    if (size > capacity()) {
+    if (size > RB_usable - RB_count) {
       // No. We need to make room first
       // Are we allowed to do that?
       if (RB_preserve) {
@@ -382,32 +589,70 @@ bool RingBuf<T>::push_back(const T *data, size_t size) {
         data += (size - RB_usable);
         size = RB_usable;
       }
-      // Make room for the data
-      moveFront(size - capacity());
+      // Make room for the data by dropping the oldest elements
+      size_t drop = size - (RB_usable - RB_count);
+      RB_head = wrap(drop);
+      RB_count -= drop;
+    }
+    // Now copy it in - in two parts, if the buffer end is hit
+    size_t to = wrap(RB_count);
+    size_t part = RB_len - to;
+    if (part >= size) {
+      memcpy(RB_buffer + to, data, size * RB_elementSize);
+    } else {
+      memcpy(RB_buffer + to, data, part * RB_elementSize);
+      memcpy(RB_buffer, data + part, (size - part) * RB_elementSize);
     }
-    // Now copy it in
-    memcpy(RB_end, data, size * RB_elementSize);
-    RB_end += size;
+    RB_count += size;
   }
   return true;
 }
 
 // operator[]: return the element the index is pointing to. If index is
-// outside the currently used area, return 0
-template <typename T>
-const T RingBuf<T>::operator[](size_t index) {
-  if (!valid()) return 0;
+// outside the currently used area, return a value-initialized T
+template <typename T, size_t N>
+const T RingBuf<T, N>::operator[](size_t index) {
+  if (!valid()) return T();
   if (index < size()) {
-    return *(RB_begin + index);
+    return RB_buffer[wrap(index)];
   }
-  return 0;
+  return T();
 }
 
-// last: return the last element added or 0, if empty/invalid
-template <typename T>
-const T RingBuf<T>::last() {
-  if (empty() || !valid()) return 0;
-  return *(RB_end - 1);
+// last: return the last element added or a value-initialized T, if empty/invalid
+template <typename T, size_t N>
+const T RingBuf<T, N>::last() {
+  if (empty() || !valid()) return T();
+  return RB_buffer[wrap(RB_count - 1)];
+}
+
+// at: return address of the element the index is pointing to or nullptr
+template <typename T, size_t N>
+const T *RingBuf<T, N>::at(size_t index) {
+  if (!valid() || index >= size()) return nullptr;
+  return RB_buffer + wrap(index);
+}
+
+// get: copy element the index is pointing to into target, if there is one
+template <typename T, size_t N>
+bool RingBuf<T, N>::get(size_t index, T& target) {
+  if (!valid()) return false;
+  LOCK_GUARD(cLock, m);
+  if (index >= RB_count) return false;
+  target = RB_buffer[wrap(index)];
+  return true;
+}
+
+// copyRange: get a stable data copy of a part of the currently used buffer
+template <typename T, size_t N>
+size_t RingBuf<T, N>::copyRange(T *target, size_t start, size_t len) {
+  if (!valid() || !target) return 0;
+  LOCK_GUARD(cLock, m);
+  // Limit the range to the used area
+  if (start >= RB_count) return 0;
+  if (len > RB_count - start) len = RB_count - start;
+  copyOut(target, start, len);
+  return len;
 }
 
 // safeCopy: get a stable data copy from currently used buffer
@@ -415,25 +660,38 @@ const T RingBuf<T>::last() {
 // len: number of elements requested
 // move: if true, copied elements will be pop()-ped
 // returns number of elements actually transferred
-template <typename T>
-size_t RingBuf<T>::safeCopy(T *target, size_t tLen, bool move) {
+template <typename T, size_t N>
+size_t RingBuf<T, N>::safeCopy(T *target, size_t tLen, bool move) {
   if (!valid()) return 0;
   if (!target) return 0;
   {
     LOCK_GUARD(cLock, m);
-    if (tLen > size()) tLen = size();
-    memcpy(target, RB_begin, tLen * RB_elementSize);
+    if (tLen > RB_count) tLen = RB_count;
+    copyOut(target, 0, tLen);
+    // Shall we remove the copied elements?
+    if (move) {
+      // Yes. Advance head
+      RB_head = (tLen == RB_count) ? 0 : wrap(tLen);
+      RB_count -= tLen;
+    }
   }
-  if (move) pop(tLen);
   return tLen;
 }
 
 // Equality: sizes and contents must be identical
-template <typename T>
-bool RingBuf<T>::operator==(RingBuf<T> &r) {
+template <typename T, size_t N>
+bool RingBuf<T, N>::operator==(RingBuf<T, N> &r) {
   if (!valid() || !r.valid()) return false;
   if (size() != r.size()) return false;
-  if (memcmp(RB_begin, r.RB_begin, size() * RB_elementSize)) return false;
+  // Compare in chunks that are contiguous in both buffers
+  size_t done = 0;
+  while (done < RB_count) {
+    size_t a = wrap(done);
+    size_t b = r.wrap(done);
+    size_t chunk = std::min(RB_count - done, std::min(RB_len - a, r.RB_len - b));
+    if (memcmp(RB_buffer + a, r.RB_buffer + b, chunk * RB_elementSize)) return false;
+    done += chunk;
+  }
   return true;
 }
 #endif
@@ -0,0 +1,126 @@
+// Copyright (c) 2021 miq1 @ gmx . de
+
+#ifndef _RINGBUFSPSC_H
+#define _RINGBUFSPSC_H
+
+#if defined(ESP8266) || defined(ESP32)
+#include <Arduino.h>
+#else
+#include <cstdint>
+#include <cstring>
+#endif
+#include <atomic>
+
+// RingBufSPSC is a lock-free variant of RingBuf for exactly one producer and one consumer.
+// The producer may be an interrupt handler (button edges, sensor pulse widths), while the
+// consumer is running in loop(). No mutex is taken, head and tail indices are synchronized
+// with acquire/release atomics instead.
+// - N is the capacity in elements and must be a power of 2
+// - the buffer is never rolled: a push_back to a full buffer is refused. The producer
+//   cannot drop elements the consumer might be reading just now!
+// - push_back() may only be called by the producer, all other modifying calls only by the consumer
+// - all functions are inline and do not allocate memory, so they are safe to be used in an
+//   IRAM_ATTR interrupt handler
+template <typename T, size_t N>
+class RingBufSPSC {
+  static_assert(N >= 2 && (N & (N - 1)) == 0, "RingBufSPSC capacity must be a power of 2");
+public:
+  // Constructor: nothing to allocate
+  RingBufSPSC() : RB_head(0), RB_tail(0) {}
+
+  // No copies or moves - the buffer is shared between producer and consumer
+  RingBufSPSC(const RingBufSPSC &r) = delete;
+  RingBufSPSC& operator=(const RingBufSPSC &r) = delete;
+
+  // size: get number of elements currently in buffer (a snapshot, as always)
+  inline size_t size() const {
+    return RB_tail.load(std::memory_order_acquire) - RB_head.load(std::memory_order_acquire);
+  }
+
+  // empty: returns true if no elements are in the buffer
+  inline bool empty() const { return size() == 0; }
+
+  // capacity: return number of unused elements in buffer
+  inline size_t capacity() const { return N - size(); }
+
+  // Producer side --------------------------------------------------------------
+
+  // push_back: add a single element. Returns false if the buffer is full.
+  inline __attribute__((always_inline)) bool push_back(const T& c) {
+    uint32_t tail = RB_tail.load(std::memory_order_relaxed);
+    // Full?
+    if (tail - RB_head.load(std::memory_order_acquire) >= N) {
+      // Yes. Drop the new element
+      return false;
+    }
+    RB_buffer[tail & (N - 1)] = c;
+    // Publish the element to the consumer
+    RB_tail.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer side --------------------------------------------------------------
+
+  // peek: get the oldest element without removing it. Returns false if the buffer is empty.
+  inline bool peek(T& target) const {
+    uint32_t head = RB_head.load(std::memory_order_relaxed);
+    if (head == RB_tail.load(std::memory_order_acquire)) return false;
+    target = RB_buffer[head & (N - 1)];
+    return true;
+  }
+
+  // pop: get the oldest element and remove it. Returns false if the buffer is empty.
+  inline bool pop(T& target) {
+    uint32_t head = RB_head.load(std::memory_order_relaxed);
+    if (head == RB_tail.load(std::memory_order_acquire)) return false;
+    target = RB_buffer[head & (N - 1)];
+    // Hand back the slot to the producer
+    RB_head.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  // pop: remove the leading numElements elements from the buffer
+  inline size_t pop(size_t numElements) {
+    uint32_t head = RB_head.load(std::memory_order_relaxed);
+    size_t used = RB_tail.load(std::memory_order_acquire) - head;
+    if (numElements > used) numElements = used;
+    RB_head.store(head + numElements, std::memory_order_release);
+    return numElements;
+  }
+
+  // safeCopy: get a stable data copy of the oldest elements
+  // target: buffer to copy data into
+  // len: number of elements requested
+  // move: if true, copied elements will be removed
+  // returns number of elements actually transferred
+  size_t safeCopy(T *target, size_t tLen, bool move = false) {
+    if (!target) return 0;
+    uint32_t head = RB_head.load(std::memory_order_relaxed);
+    size_t used = RB_tail.load(std::memory_order_acquire) - head;
+    if (tLen > used) tLen = used;
+    // Copy in up to two parts
+    size_t from = head & (N - 1);
+    size_t part = N - from;
+    if (part >= tLen) {
+      memcpy(target, RB_buffer + from, tLen * sizeof(T));
+    } else {
+      memcpy(target, RB_buffer + from, part * sizeof(T));
+      memcpy(target + part, RB_buffer, (tLen - part) * sizeof(T));
+    }
+    if (move) {
+      RB_head.store(head + tLen, std::memory_order_release);
+    }
+    return tLen;
+  }
+
+  // clear: drop all elements currently in the buffer
+  inline void clear() {
+    RB_head.store(RB_tail.load(std::memory_order_acquire), std::memory_order_release);
+  }
+
+protected:
+  T RB_buffer[N];                          // The data buffer proper
+  std::atomic<uint32_t> RB_head;           // Free-running index of the oldest element (written by consumer)
+  std::atomic<uint32_t> RB_tail;           // Free-running index behind the newest element (written by producer)
+};
+#endif
@@ -0,0 +1,56 @@
+// RttStats
+// Copyright 2021 by miq1@gmx.de
+
+#include "RttStats.h"
+
+RttStats::RttStats() :
+  RS_sum(0),
+  RS_count(0),
+  RS_timeouts(0),
+  RS_min(0xFFFF),
+  RS_max(0) { }
+
+// sample: add the round trip time of a response
+void RttStats::sample(uint32_t ms) {
+  uint16_t t = (ms > 0xFFFF) ? 0xFFFF : ms;
+  RS_window.push_back(t);
+  // Stop counting before the average would lose its base
+  if (RS_count < 0xFFFF) {
+    RS_count++;
+    RS_sum += t;
+  }
+  if (t < RS_min) RS_min = t;
+  if (t > RS_max) RS_max = t;
+}
+
+// timeout: count a request that got no response
+void RttStats::timeout() {
+  if (RS_timeouts < 0xFFFF) RS_timeouts++;
+}
+
+// p95: get the 95th percentile of the recent round trip times
+uint16_t RttStats::p95() {
+  uint16_t sorted[RTT_WINDOW];
+  size_t n = RS_window.safeCopy(sorted, RTT_WINDOW);
+  if (!n) return 0;
+  // Insertion sort - the window is small
+  for (size_t i = 1; i < n; i++) {
+    uint16_t v = sorted[i];
+    size_t j = i;
+    while (j && sorted[j - 1] > v) {
+      sorted[j] = sorted[j - 1];
+      j--;
+    }
+    sorted[j] = v;
+  }
+  return sorted[(n * 95 + 99) / 100 - 1];
+}
+
+// suggestTimeout: get a response timeout covering the recent round trip times
+uint32_t RttStats::suggestTimeout(uint32_t lower, uint32_t upper) {
+  if (RS_window.size() < RTT_MINSAMPLES) return upper;
+  uint32_t t = 3 * (uint32_t)p95() + 200;
+  if (t < lower) return lower;
+  if (t > upper) return upper;
+  return t;
+}
@@ -0,0 +1,49 @@
+// RttStats
+// Copyright 2021 by miq1@gmx.de
+//
+// RttStats keeps the round trip times of the Modbus requests to one remote device.
+// Minimum, maximum and average are taken over all responses since the start, the 95th
+// percentile over the last RTT_WINDOW responses. Timeouts are counted separately.
+// All times are in milliseconds; counts and times stop at 65535.
+
+#ifndef _RTTSTATS_H
+#define _RTTSTATS_H
+
+#include <Arduino.h>
+#include "RingBuf.h"
+
+#define RTT_WINDOW 32
+#define RTT_MINSAMPLES 4
+
+class RttStats {
+public:
+  RttStats();
+
+  // sample: add the round trip time of a response
+  void sample(uint32_t ms);
+
+  // timeout: count a request that got no response
+  void timeout();
+
+  inline uint16_t count() { return RS_count; }
+  inline uint16_t timeouts() { return RS_timeouts; }
+  inline uint16_t minimum() { return RS_count ? RS_min : 0; }
+  inline uint16_t maximum() { return RS_max; }
+  inline uint16_t average() { return RS_count ? RS_sum / RS_count : 0; }
+  // p95: get the 95th percentile of the recent round trip times
+  uint16_t p95();
+
+  // suggestTimeout: get a response timeout covering the recent round trip times with some margin,
+  // limited to lower..upper. Until RTT_MINSAMPLES responses have been seen, upper is returned.
+  uint32_t suggestTimeout(uint32_t lower, uint32_t upper);
+
+protected:
+  RingBuf<uint16_t, RTT_WINDOW> RS_window;  // Recent round trip times
+  uint32_t RS_sum;                          // Sum of all round trip times counted
+  uint16_t RS_count;                        // Number of responses
+  uint16_t RS_timeouts;                     // Number of timeouts
+  uint16_t RS_min;                          // Shortest round trip time
+  uint16_t RS_max;                          // Longest round trip time
+};
+
+#endif
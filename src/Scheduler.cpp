@@ -0,0 +1,133 @@
+// Scheduler
+// Copyright 2021 by miq1@gmx.de
+
+#include "Scheduler.h"
+
+Scheduler::Scheduler() :
+  S_taskCnt(0),
+  S_heapCnt(0) { }
+
+// add: register a task
+int8_t Scheduler::add(TaskFunc func, uint32_t interval, uint32_t delay) {
+  if (!func || S_taskCnt >= SCHEDULER_MAX) return -1;
+  int8_t id = S_taskCnt++;
+  S_tasks[id] = Task { func, interval, (uint32_t)millis() + delay, -1 };
+  insert(id);
+  return id;
+}
+
+// reschedule: (re)start a task to run delay milliseconds from now
+bool Scheduler::reschedule(int8_t id, uint32_t delay) {
+  if (id < 0 || id >= S_taskCnt) return false;
+  remove(id);
+  S_tasks[id].due = millis() + delay;
+  insert(id);
+  return true;
+}
+
+// setInterval: change the interval of a task
+bool Scheduler::setInterval(int8_t id, uint32_t interval) {
+  if (id < 0 || id >= S_taskCnt) return false;
+  S_tasks[id].interval = interval;
+  return true;
+}
+
+// stop: take a task out of the schedule
+bool Scheduler::stop(int8_t id) {
+  if (id < 0 || id >= S_taskCnt) return false;
+  remove(id);
+  return true;
+}
+
+// isActive: true if a task is scheduled
+bool Scheduler::isActive(int8_t id) {
+  if (id < 0 || id >= S_taskCnt) return false;
+  return S_tasks[id].pos >= 0;
+}
+
+// run: call all tasks that are due
+uint32_t Scheduler::run() {
+  uint32_t now = millis();
+  // Loop as long as the earliest task is due
+  while (S_heapCnt && (int32_t)(now - S_tasks[S_heap[0]].due) >= 0) {
+    int8_t id = S_heap[0];
+    Task& t = S_tasks[id];
+    // Periodic task?
+    if (t.interval) {
+      // Yes. Next call is relative to this one to avoid drift - unless we are lagging a full interval
+      t.due += t.interval;
+      if ((int32_t)(now - t.due) >= 0) t.due = now + t.interval;
+      siftDown(0);
+    } else {
+      // No, one-shot. Take it out
+      remove(id);
+    }
+    // The task may reschedule or stop itself, so it is called after the heap is settled
+    t.func();
+    now = millis();
+  }
+  return nextDue();
+}
+
+// nextDue: milliseconds until the next task is due
+uint32_t Scheduler::nextDue() {
+  if (!S_heapCnt) return 0xFFFFFFFF;
+  int32_t d = S_tasks[S_heap[0]].due - millis();
+  return d > 0 ? d : 0;
+}
+
+// place: put a task into a heap slot
+void Scheduler::place(uint8_t hpos, int8_t id) {
+  S_heap[hpos] = id;
+  S_tasks[id].pos = hpos;
+}
+
+// siftUp: move a heap slot up until its parent is due earlier
+void Scheduler::siftUp(uint8_t hpos) {
+  int8_t id = S_heap[hpos];
+  while (hpos > 0) {
+    uint8_t parent = (hpos - 1) / 2;
+    if (!earlier(id, S_heap[parent])) break;
+    place(hpos, S_heap[parent]);
+    hpos = parent;
+  }
+  place(hpos, id);
+}
+
+// siftDown: move a heap slot down until both children are due later
+void Scheduler::siftDown(uint8_t hpos) {
+  int8_t id = S_heap[hpos];
+  while (true) {
+    uint8_t child = hpos * 2 + 1;
+    if (child >= S_heapCnt) break;
+    // Take the earlier of both children
+    if (child + 1 < S_heapCnt && earlier(S_heap[child + 1], S_heap[child])) child++;
+    if (!earlier(S_heap[child], id)) break;
+    place(hpos, S_heap[child]);
+    hpos = child;
+  }
+  place(hpos, id);
+}
+
+// insert: put a task into the heap
+void Scheduler::insert(int8_t id) {
+  if (S_tasks[id].pos >= 0) return;
+  place(S_heapCnt++, id);
+  siftUp(S_heapCnt - 1);
+}
+
+// remove: take a task out of the heap
+void Scheduler::remove(int8_t id) {
+  int8_t hpos = S_tasks[id].pos;
+  if (hpos < 0) return;
+  S_tasks[id].pos = -1;
+  S_heapCnt--;
+  // Was it the last slot?
+  if (hpos != S_heapCnt) {
+    // No. Fill the gap with the last slot and restore the heap order
+    int8_t moved = S_heap[S_heapCnt];
+    place(hpos, moved);
+    siftUp(hpos);
+    siftDown(S_tasks[moved].pos);
+  }
+}
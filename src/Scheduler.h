@@ -0,0 +1,71 @@
+// Scheduler
+// Copyright 2021 by miq1@gmx.de
+//
+// Scheduler is a small cooperative deadline scheduler. Tasks are plain functions that are
+// called periodically or once after a delay. The tasks are kept in a min-heap ordered by
+// their due times, so run() only has to look at the top of the heap to find out if
+// anything is to be done at all.
+// Tasks are never interrupted - a task is run to its end before the next due task is started.
+
+#ifndef _SCHEDULER_H
+#define _SCHEDULER_H
+
+#include <Arduino.h>
+
+#define SCHEDULER_MAX 10
+
+// Task function type
+typedef void (*TaskFunc)();
+
+class Scheduler {
+public:
+  Scheduler();
+
+  // add: register a task.
+  // - func: function to call
+  // - interval: milliseconds between calls. 0 makes it a one-shot task, that is stopped after it has run
+  // - delay: milliseconds until the first call
+  // Returns the task ID or -1 if SCHEDULER_MAX tasks are registered already.
+  int8_t add(TaskFunc func, uint32_t interval, uint32_t delay);
+
+  // reschedule: (re)start a task to run delay milliseconds from now
+  bool reschedule(int8_t id, uint32_t delay);
+
+  // setInterval: change the interval of a task. Will become effective after the next call
+  bool setInterval(int8_t id, uint32_t interval);
+
+  // stop: take a task out of the schedule. It may be started again with reschedule()
+  bool stop(int8_t id);
+
+  // isActive: true if a task is scheduled
+  bool isActive(int8_t id);
+
+  // run: call all tasks that are due.
+  // Returns the milliseconds until the next task is due, or 0xFFFFFFFF if nothing is scheduled.
+  uint32_t run();
+
+  // nextDue: milliseconds until the next task is due (0 if one is due already)
+  uint32_t nextDue();
+
+protected:
+  struct Task {
+    TaskFunc func;             // Function to call
+    uint32_t interval;         // Interval in ms, 0 for a one-shot task
+    uint32_t due;              // Time the next call is due
+    int8_t pos;                // Position in the heap, -1 if not scheduled
+  };
+  Task S_tasks[SCHEDULER_MAX];  // All registered tasks
+  int8_t S_heap[SCHEDULER_MAX]; // Task IDs, ordered as min-heap of due times
+  uint8_t S_taskCnt;            // Number of registered tasks
+  uint8_t S_heapCnt;            // Number of scheduled tasks
+
+  // earlier: true if task a is due before task b (wrap-around safe)
+  inline bool earlier(int8_t a, int8_t b) { return (int32_t)(S_tasks[a].due - S_tasks[b].due) < 0; }
+  void place(uint8_t hpos, int8_t id);  // Put a task into a heap slot
+  void siftUp(uint8_t hpos);            // Move a heap slot up to its place
+  void siftDown(uint8_t hpos);          // Move a heap slot down to its place
+  void insert(int8_t id);               // Put a task into the heap
+  void remove(int8_t id);               // Take a task out of the heap
+};
+
+#endif
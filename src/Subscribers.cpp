@@ -0,0 +1,76 @@
+// Subscribers
+// Copyright 2021 by miq1@gmx.de
+
+#include "Subscribers.h"
+
+Subscribers::Subscribers() {
+  for (auto& s : SU_list) {
+    s.active = false;
+  }
+}
+
+// subscribe: add or renew a subscription
+int8_t Subscribers::subscribe(IPAddress ip, uint16_t port, uint8_t SID, uint8_t slot, uint8_t index, uint16_t tag, uint16_t leaseSecs) {
+  int8_t freeSlot = -1;
+
+  for (uint8_t i = 0; i < SUBSCRIBERS_MAX; i++) {
+    Subscription& s = SU_list[i];
+    // Drop run out entries on the way
+    if (s.active && expired(s)) {
+      s.active = false;
+    }
+    if (s.active) {
+      // Known subscriber?
+      if (s.ip == ip && s.port == port && s.SID == SID && s.index == index) {
+        // Yes. Cancel or renew it
+        if (leaseSecs == 0) {
+          s.active = false;
+        } else {
+          s.slot = slot;
+          s.tag = tag;
+          s.fails = 0;
+          s.expires = millis() + leaseSecs * 1000UL;
+        }
+        return i;
+      }
+    } else if (freeSlot < 0) {
+      freeSlot = i;
+    }
+  }
+  // Unknown subscriber. Nothing to cancel?
+  if (leaseSecs == 0) return -1;
+  // New subscriber. Do we have room for it?
+  if (freeSlot >= 0) {
+    SU_list[freeSlot] = Subscription { ip, port, SID, slot, index, tag, 0, (uint32_t)(millis() + leaseSecs * 1000UL), true };
+  }
+  return freeSlot;
+}
+
+// get: return a valid subscription entry
+const Subscription *Subscribers::get(uint8_t i) {
+  if (i >= SUBSCRIBERS_MAX || !SU_list[i].active) return nullptr;
+  if (expired(SU_list[i])) {
+    SU_list[i].active = false;
+    return nullptr;
+  }
+  return &SU_list[i];
+}
+
+// pushed: count failed pushes and drop the subscription if too many failed in a row
+void Subscribers::pushed(uint8_t i, bool ok) {
+  if (i >= SUBSCRIBERS_MAX || !SU_list[i].active) return;
+  if (ok) {
+    SU_list[i].fails = 0;
+  } else if (++SU_list[i].fails >= SUBSCRIBER_FAILS) {
+    SU_list[i].active = false;
+  }
+}
+
+// count: number of valid subscriptions
+uint8_t Subscribers::count() {
+  uint8_t cnt = 0;
+  for (uint8_t i = 0; i < SUBSCRIBERS_MAX; i++) {
+    if (get(i)) cnt++;
+  }
+  return cnt;
+}
@@ -0,0 +1,55 @@
+// Subscribers
+// Copyright 2021 by miq1@gmx.de
+//
+// Subscribers keeps the list of remote devices that want fresh readings of a local sensor
+// pushed to them, instead of polling for them.
+// Each subscription is given a lease time and has to be renewed by the subscriber before
+// it has run out. A subscription is dropped as well if several pushes in a row have failed.
+
+#ifndef _SUBSCRIBERS_H
+#define _SUBSCRIBERS_H
+
+#include <Arduino.h>
+#include <IPAddress.h>
+
+#define SUBSCRIBERS_MAX 8
+#define SUBSCRIBER_FAILS 3
+
+struct Subscription {
+  IPAddress ip;              // Subscriber's Modbus server address
+  uint16_t port;             // Subscriber's Modbus server port
+  uint8_t SID;               // Subscriber's Modbus server ID
+  uint8_t slot;              // Local sensor subscribed to (0 or 1)
+  uint8_t index;             // Subscriber's sensor index, returned in pushes
+  uint16_t tag;              // Subscriber's source tag, returned in pushes
+  uint8_t fails;             // Number of failed pushes in a row
+  uint32_t expires;          // Time the lease will run out
+  bool active;               // Entry is in use
+};
+
+class Subscribers {
+public:
+  Subscribers();
+
+  // subscribe: add or renew a subscription for leaseSecs seconds.
+  // A subscriber is identified by ip, port, SID and index. A leaseSecs of 0 will cancel the subscription.
+  // Returns the entry number or -1 if the list is full.
+  int8_t subscribe(IPAddress ip, uint16_t port, uint8_t SID, uint8_t slot, uint8_t index, uint16_t tag, uint16_t leaseSecs);
+
+  // get: return subscription entry i, if it is active and its lease has not run out yet. nullptr else.
+  const Subscription *get(uint8_t i);
+
+  // pushed: report the outcome of a push to entry i
+  void pushed(uint8_t i, bool ok);
+
+  // count: number of valid subscriptions
+  uint8_t count();
+
+protected:
+  Subscription SU_list[SUBSCRIBERS_MAX];
+
+  // expired: true if the lease of s has run out (wrap-around safe)
+  inline bool expired(const Subscription& s) { return (int32_t)(millis() - s.expires) >= 0; }
+};
+
+#endif
@@ -7,12 +7,18 @@
 #include <ESP8266mDNS.h>
 #include <LittleFS.h>
 #include <ESP8266WebServer.h>
-#include "DHTesp.h"
+#include "DHTasync.h"
 #include "Version.h"
 #include "Blinker.h"
 #include "Buttoner.h"
 #include "RingBuf.h"
-#include "ModbusClientTCPAsync.h"
+#include "Scheduler.h"
+#include "RegisterMap.h"
+#include "Subscribers.h"
+#include "ClientPool.h"
+#include "RttStats.h"
+#include "HistoryLog.h"
+#include "HistoryTier.h"
 #include "ModbusServerTCPAsync.h"
 #include "Logging.h"
 
@@ -50,7 +56,11 @@ ESP8266WebServer HTMLserver(80);
 #define CONFIG_HTML "/config.html"
 #define SETTINGS "/settings.bin"
 #define RESTARTS "/restarts.bin"
+#define HISTORY_LOG "/history.bin"
+#define HISTORY_HOURS "/hours.bin"
+#define HISTORY_DAYS "/days.bin"
 String deviceInfo(1024);
+String configNote;                     // Rejected config input, shown once on the status page
 
 // Target address for Modbus device
 struct ModbusTarget {
@@ -65,6 +75,11 @@ struct ModbusTarget {
 uint16_t Hysteresis = 0xAAAA;                               // holds last 16 results
 uint16_t HYSTERESIS_MASK = 0x000F;                          // Bit mask to check last n measurements
 uint16_t cState = 0;                                        // last evaluation result for switching conditions
+uint8_t s1cond = 0;                                         // Results of last conditions check for sensor 0
+uint8_t s2cond = 0;                                         // ... for sensor 1
+uint8_t cccond = 0;                                         // ... for the combined conditions
+uint16_t failCnt = 0;                                       // Counter for measurement failures
+uint16_t measureSeq = 0;                                    // Number of evaluated measurement cycles
 
 // Target tracking
 uint16_t targetHealth = 0;
@@ -75,15 +90,22 @@ struct TT {
   uint16_t count;                                           // Number of consecutive occurrences
   TT() : err(SUCCESS), count(0) {}
 };
-const uint16_t TTslots(30);                                 // Number of error groups tracked
 uint16_t ttSlot{0};                                         // Currently active group
 TT targetTrack[TTslots];                                    // Storage for error tracking
+RttStats rtt[3];                                            // Round trip times to S0, S1 and target
 
 // Set up blink patterns for all 4 LEDs
 Blinker signalLED(SIGNAL_LED);
 Blinker S0LED(S0STATUS_LED);
 Blinker S1LED(S1STATUS_LED);
 Blinker targetLED(TARGET_LED);
+// All LEDs are advanced by LEDs.update()
+LedEngine LEDs;
+
+// Cooperative scheduler for the periodic work in RUN mode
+Scheduler tasks;
+// Scheduler for the work needed in MANUAL mode as well: settings commits and reboot requests
+Scheduler services;
 
 // Blink pattern for "target ON": quick triple, pause
 const uint16_t TARGET_ON_BLINK(0xA800);
@@ -113,7 +135,7 @@ long unsigned int rebootGrace = 0;        // Wait timer for confirming second re
 
 // Two DHT sensors. In setup() will be found out if both are connected
 struct mySensor {
-  DHTesp sensor;                               // DHT object
+  DHTasync sensor;                             // DHT object
   TempAndHumidity th;                          // Measured values
   float dewPoint;                              // Calculated from measurement
   Blinker& statusLED;
@@ -121,12 +143,24 @@ struct mySensor {
   uint8_t sensor01;                            // Slot 0 or 1
   bool isRelevant;
   bool lastCheckOK;
+  bool checking;                               // Running read is a sensor check only
+  uint16_t pubSeq;                             // Sequence number of the last reading pushed to subscribers
+  uint16_t pushSeq;                            // Sequence number of the last reading pushed by the Modbus source
+  uint16_t pushInterval;                       // Source's measuring interval in seconds, 0 if no pushes are coming in
+  uint32_t lastPush;                           // Time of the last pushed reading
+  uint32_t lastSubscribe;                      // Time of the last subscription request, 0 if none sent
   mySensor(Blinker& sLED, uint8_t whichOne) : 
     statusLED(sLED), 
     healthTracker(0), 
     sensor01(whichOne), 
     isRelevant(false),
-    lastCheckOK(false) { }
+    lastCheckOK(false),
+    checking(false),
+    pubSeq(0),
+    pushSeq(0),
+    pushInterval(0),
+    lastPush(0),
+    lastSubscribe(0) { }
 };
 mySensor DHT0(S0LED, 0);
 mySensor DHT1(S1LED, 1);
@@ -157,9 +191,10 @@ public:
 };
 
 // Settings data
-const uint16_t MAGICVALUE(0x4716);
+const uint16_t MAGICVALUE(0x4717);
+const uint16_t MAGICVALUE_NOSLOTS(0x4716);  // Settings written before the history slots were added
 const uint8_t STRINGPARMLENGTH(32);
-const uint8_t CONFIGPARAMS(48);
+const uint8_t CONFIGPARAMS(49);
 struct SetData {
   uint16_t magicValue;                   // 0x4712 upon successful initialization
   char deviceName[STRINGPARMLENGTH];     // CV0 Name of this device for mDNS, OTA etc.
@@ -193,6 +228,7 @@ struct SetData {
   DEVICECOND DewDiff;                    // CV46 (S0 - S1) dew point condition 0:ignore, 1:<, 2:>
   float Dew;                             // CV47 (S0 - S1) condition dew point value
   bool fallbackSwitch;                   // CV48 Fallback if sensors etc. will fail
+  uint16_t historySlots;                 // CV49 Number of history slots in 24h
   SetData() {
     magicValue = 0;
   }
@@ -201,54 +237,77 @@ uint16_t restarts;                     // number of reboots
 
 // History data 
 // Measurements are stored for 24h
-const uint16_t HistorySlots(120);      // Number of measurements collected in 24h
+const uint16_t HISTORY_DEFAULT(120);   // Default number of measurements collected in 24h
+const uint32_t HISTORY_RESERVE(16384); // Heap to be kept free when allocating the history
+uint16_t HistorySlots(0);              // Number of measurements collected in 24h
 const uint16_t HistoryAddress(400);    // Modbus register number of first history data
-struct HistoryEntry {
-  uint16_t temp0;                      // Sensor 0 temperature t0 as: uint16_t((t0 + 100.0) * 10.0) 
-  uint16_t hum0;                       // Sensor 0 humidity h0 as: uint16_t(h0 * 10.0) 
-  uint16_t temp1;                      // Sensor 1 temperature t1 as: uint16_t((t1 + 100.0) * 10.0) 
-  uint16_t hum1;                       // Sensor 1 humidity h1 as: uint16_t(h1 * 10.0) 
-  uint8_t on;                          // Target ON state as: (samples(ON) * 100) / samples
-};
-// Storage for history data
-HistoryEntry history[HistorySlots];
+// Storage for history data (see HistoryLog.h for HistoryEntry), allocated by resizeHistory()
+HistoryEntry *history = nullptr;
+// Completed slots are kept on flash as well. The log is compacted to the last 24h when it holds 3 days.
+HistoryLog historyLog(HISTORY_LOG, 3 * HISTORY_DEFAULT, 86400);
+// Longer term history: hourly rollups of the slots for 30 days, daily rollups of the hours for a year
+HistoryTier hourlyTier(HISTORY_HOURS, 3600, 720);
+HistoryTier dailyTier(HISTORY_DAYS, 86400, 366);
 // History evaluation struct
 class CalcHistory {
 protected:
-  float t0sum;                         // Sum of all t0 values in a sampling period
-  float h0sum;                         // Sum of all h0 values in a sampling period
-  float t1sum;                         // Sum of all t0 values in a sampling period
-  float h1sum;                         // Sum of all h0 values in a sampling period
+  float sum[HV_COUNT];                 // Sums of all values in a sampling period
+  float low[HV_COUNT];                 // Lowest valid values in a sampling period
+  float high[HV_COUNT];                // Highest valid values in a sampling period
   uint16_t onCnt;                      // Number of samples with target==ON
   uint16_t count;                      // Number of samples collected
   uint16_t historySlot;         // Current slot
+  time_t slotStart;             // Time of the first sample in the current slot
   // reset: init counters
   void reset() {
-    t0sum = h0sum = t1sum = h1sum = 0.0;
+    for (uint8_t i = 0; i < HV_COUNT; i++) {
+      sum[i] = 0.0;
+      low[i] = INFINITY;
+      high[i] = -INFINITY;
+    }
     onCnt = count = 0;
   }
+  // encode: convert a value to the history format
+  static uint16_t encode(uint8_t hv, float v) {
+    return (uint16_t)((hv == HV_TEMP0 || hv == HV_TEMP1) ? (v + 100.0) * 10.0 : v * 10.0);
+  }
   // push: move collected data into history slot
   void push(HistoryEntry& hE) {
     if (count) {
-      hE.temp0 = (uint16_t)(((t0sum / count) + 100.0) * 10.0);
-      hE.hum0 = (uint16_t)((h0sum / count) * 10.0);
-      hE.temp1 = (uint16_t)(((t1sum / count) + 100.0) * 10.0);
-      hE.hum1 = (uint16_t)((h1sum / count) * 10.0);
+      hE.stamp = slotStart;
+      hE.count = count;
       hE.on = (uint8_t)((onCnt * 100) / count);
+      for (uint8_t i = 0; i < HV_COUNT; i++) {
+        hE.avg[i] = encode(i, sum[i] / count);
+        // No valid value at all? Leave minimum and maximum empty
+        hE.low[i] = isinf(low[i]) ? 0 : encode(i, low[i]);
+        hE.high[i] = isinf(high[i]) ? 0 : encode(i, high[i]);
+      }
+      // Keep it on flash as well
+      historyLog.append(hE);
+      // Roll it up into the running hour. A completed hour goes into the running day
+      HistoryEntry hour;
+      HistoryEntry day;
+      if (hE.stamp >= HL_MINTIME && hourlyTier.add(hE, hour)) {
+        dailyTier.add(hour, day);
+        dailyTier.save();
+      }
     }
   }
 public:
   // Constructor
-  CalcHistory() : historySlot(0) { reset(); }
-  // calcSlot: determine history slot from hour and minute of current time
-  static uint16_t calcSlot() {
-    // We will need date and/or time
-    time_t now = time(NULL);
+  CalcHistory() : historySlot(0), slotStart(0) { reset(); }
+  // calcSlot: determine history slot from hour and minute of the given time, default is now
+  static uint16_t calcSlot(time_t now = time(NULL)) {
     tm tm;
     localtime_r(&now, &tm);           // update the structure tm with the current time
     uint16_t minV = tm.tm_hour * 60 + tm.tm_min;    // Minute of day
     return HistorySlots ? minV / (1440 / HistorySlots) : 0;   // find slot
   }
+  // restart: continue collecting into the current slot after the slots have changed
+  void restart() {
+    historySlot = calcSlot();
+  }
   // collect: add another set of values
   uint16_t collect(float t0, float h0, float t1, float h1, bool on) {
     // get current slot
@@ -260,30 +319,20 @@ public:
       historySlot = actSlot;
       reset();
     }
-    count++;
-    // If value is NaN or humidity is zero (unlikely...), do not use it, but promote the current average
-    if (isnanf(t0) || h0 == 0.0) {
-      t0sum += t0sum / count;
-    } else {
-      t0sum += t0;
-    }
-    // If value is NaN or humidity is zero (unlikely...), do not use it, but promote the current average
-    if (isnanf(h0) || h0 == 0.0) {
-      h0sum += h0sum / count;
-    } else {
-      h0sum += h0;
-    }
-    // If value is NaN or humidity is zero (unlikely...), do not use it, but promote the current average
-    if (isnanf(t1) || h1 == 0.0) {
-      t1sum += t1sum / count;
-    } else {
-      t1sum += t1;
+    if (!count) {
+      slotStart = time(NULL);
     }
-    // If value is NaN or humidity is zero (unlikely...), do not use it, but promote the current average
-    if (isnanf(h1) || h1 == 0.0) {
-      h1sum += h1sum / count;
-    } else {
-      h1sum += h1;
+    count++;
+    float v[HV_COUNT] = { t0, h0, t1, h1 };
+    for (uint8_t i = 0; i < HV_COUNT; i++) {
+      // If value is NaN or the sensor's humidity is zero (unlikely...), do not use it, but promote the current average
+      if (isnanf(v[i]) || (i < HV_TEMP1 ? h0 : h1) == 0.0) {
+        sum[i] += sum[i] / count;
+      } else {
+        sum[i] += v[i];
+        if (v[i] < low[i]) low[i] = v[i];
+        if (v[i] > high[i]) high[i] = v[i];
+      }
     }
     onCnt += (on ? 1 : 0);
     return count;
@@ -291,6 +340,61 @@ public:
 };
 CalcHistory calcHistory;
 
+// historyFits: check if the history can be resized to the given number of slots
+bool historyFits(uint16_t slots) {
+  // Same limits as for the history slots register
+  if (checkWrite(regAddress(RF_HIST_SLOTS), slots) != RC_OK) return false;
+  if (slots == HistorySlots) return true;
+  // The old slots are kept until they are sorted into the new ones
+  return ESP.getFreeHeap() >= slots * sizeof(HistoryEntry) + HISTORY_RESERVE;
+}
+
+// resizeHistory: allocate the history for a new number of slots.
+// The entries are sorted into the new slots by time. Returns false if there was not enough memory.
+bool resizeHistory(uint16_t slots) {
+  if (slots == HistorySlots) return true;
+  if (!historyFits(slots)) return false;
+  HistoryEntry *h = new (std::nothrow) HistoryEntry[slots];
+  if (!h) return false;
+  memset(h, 0, slots * sizeof(HistoryEntry));
+
+  HistoryEntry *oldHistory = history;
+  uint16_t oldSlots = HistorySlots;
+  history = h;
+  HistorySlots = slots;
+  // Sort the old entries into the new slots
+  uint32_t width = 86400 / slots;
+  for (uint16_t i = 0; i < oldSlots; i++) {
+    HistoryEntry& o = oldHistory[i];
+    if (!o.stamp) continue;
+    HistoryEntry& e = history[CalcHistory::calcSlot(o.stamp)];
+    // Empty or older than a slot width? Then take it. Entries of the same slot are merged.
+    if (!e.stamp || o.stamp >= e.stamp + width) {
+      e = o;
+    } else if (o.stamp + width > e.stamp) {
+      HistoryTier::merge(e, o);
+      if (o.stamp < e.stamp) e.stamp = o.stamp;
+    }
+  }
+  delete[] oldHistory;
+  historyLog.setLimit(3 * slots);
+  calcHistory.restart();
+  LOG_I("History has %u slots now\n", slots);
+  return true;
+}
+
+// restoreHistory: put a slot read from the history log back into its place
+void restoreHistory(const HistoryEntry& entry) {
+  history[CalcHistory::calcSlot(entry.stamp)] = entry;
+}
+
+// saveHistory: save the history not on flash yet, f.i. before a restart
+void saveHistory() {
+  historyLog.flush();
+  hourlyTier.save();
+  dailyTier.save();
+}
+
 // Write both SETTINGS and SET_JS files with current settings data
 // Some helper functions first
 void writeSetting(Print& st, const char *header, uint8_t num, uint8_t target) {
@@ -400,6 +504,7 @@ int writeSettings() {
       writeSetting(sJ, head, 46, settings.DewDiff);
       writeSetting(sJ, head, 47, settings.Dew);
       writeSetting(sJ, head, 48, (uint8_t)(settings.fallbackSwitch ? 1 : 0));
+      writeSetting(sJ, head, 49, settings.historySlots);
       // Write function footer
       sJ.println("}");
       sJ.close();
@@ -414,6 +519,211 @@ int writeSettings() {
   return rc;
 }
 
+// Deferred settings persistence.
+// Modbus writes only mark the settings dirty; commitTask() will write them after a quiet period.
+// A series of writes thus will cost a single flash write, done outside of the Modbus worker.
+const uint32_t COMMIT_QUIET(3000);     // ms without further changes before the settings are written
+const uint32_t COMMIT_MAXDELAY(30000);  // ms a change may be postponed at most
+bool settingsDirty = false;            // Settings were changed, but not written yet
+uint32_t dirtySince = 0;               // Time of the first unwritten change
+bool commitRequested = false;          // Commit register was written
+int8_t commitTaskID = -1;              // Scheduler ID of commitTask
+
+// Define the event types
+enum S_EVENT : uint8_t  { 
+  NO_EVENT=0, DATE_CHANGE,
+  BOOT_DATE, BOOT_TIME, 
+  MASTER_ON, MASTER_OFF,
+  TARGET_ON, TARGET_OFF,
+  ENTER_MAN, EXIT_MAN,
+  FAIL_FB,
+};
+const char *eventname[] = { 
+  "no event", "date change", "boot date", "boot time", 
+  "MASTER on", "MASTER off", 
+  "target on", "target off", 
+  "enter manual", "exit manual",
+  "failure fallback",
+};
+// Event buffer - fixed size, no heap allocation
+RingBuf<uint16_t, MAXEVENT> events;
+
+// Register image: all registers 1..REG_END - 1, held in Modbus (big endian) byte order.
+// It is refreshed whenever the data behind a register changes, so FC03 only has to copy it.
+// (Index 0 is unused to have register numbers as indexes)
+uint16_t regImage[REG_END];
+
+// Input register image: the FC04 block 1..IR_END - 1, in Modbus byte order as well
+uint16_t inputImage[IR_END];
+
+// putWord: store a value in Modbus (big endian) byte order
+inline void putWord(uint16_t *word, uint16_t value) {
+  uint8_t *cp = (uint8_t *)word;
+  cp[0] = (value >> 8) & 0xFF;
+  cp[1] = value & 0xFF;
+}
+
+// setImage: put a value into the register image
+inline void setImage(uint16_t address, uint16_t value) {
+  putWord(regImage + address, value);
+}
+
+// setInput: put a value into the input register image
+inline void setInput(uint16_t address, uint16_t value) {
+  putWord(inputImage + address, value);
+}
+
+// setImageFloat: put a float value into two registers of the register image
+void setImageFloat(uint16_t address, float value) {
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  setImage(address, (bits >> 16) & 0xFFFF);
+  setImage(address + 1, bits & 0xFFFF);
+}
+
+// fieldFloat: get the value bound to a RE_FLOAT register
+float fieldFloat(const RegDescriptor& r) {
+  mySensor& ms = r.index ? DHT1 : DHT0;
+  switch (r.field) {
+  case RF_VALUE_TEMP: return ms.th.temperature;
+  case RF_VALUE_HUM:  return ms.th.humidity;
+  case RF_VALUE_DEW:  return ms.dewPoint;
+  default:            return 0.0;
+  }
+}
+
+// fieldWord: get the value bound to a single word register, encoded as described
+uint16_t fieldWord(const RegDescriptor& r) {
+  // Index 0 and 1 are the sensors, 2 the target or the combined conditions
+  bool isSensor = (r.index < 2);
+  SetData::SensorData& sd = settings.sensor[r.index & 1];
+  IPAddress& ip = isSensor ? sd.IP : settings.targetIP;
+
+  switch (r.field) {
+  case RF_MASTER:       return settings.masterSwitch ? 1 : 0;
+  case RF_SWITCHED:     return switchedON ? 1 : 0;
+  case RF_RESTARTS:     return restarts;
+  case RF_RUNTIME:      return runTime;
+  case RF_HEALTH:       return isSensor ? (r.index ? DHT1 : DHT0).healthTracker : targetHealth;
+  case RF_INTERVAL:     return settings.measuringInterval;
+  case RF_HYSTERESIS:   return settings.hystSteps;
+  case RF_TYPE:         return isSensor ? sd.type : settings.Target;
+  case RF_IP:
+    if (r.encoding == RE_IP_HI) return (ip[0] << 8) | ip[1];
+    return (ip[2] << 8) | ip[3];
+  case RF_PORT:         return isSensor ? sd.port : settings.targetPort;
+  case RF_SID:          return isSensor ? ((sd.SID << 8) | sd.slot) : (settings.targetSID << 8);
+  case RF_COND_TEMP:    return isSensor ? encodeCondition(sd.TempMode, sd.Temp) : encodeCondition(settings.TempDiff, settings.Temp);
+  case RF_COND_HUM:     return isSensor ? encodeCondition(sd.HumMode, sd.Hum) : encodeCondition(settings.HumDiff, settings.Hum);
+  case RF_COND_DEW:     return isSensor ? encodeCondition(sd.DewMode, sd.Dew) : encodeCondition(settings.DewDiff, settings.Dew);
+  case RF_CSTATE:       return cState;
+  case RF_FALLBACK:     return settings.fallbackSwitch ? 1 : 0;
+  case RF_HIST_SLOTS:   return HistorySlots;
+  case RF_HIST_ADDRESS: return HistoryAddress;
+  case RF_HIST_CURRENT: return calcHistory.calcSlot();
+  case RF_COMMIT:       return settingsDirty ? 1 : 0;
+  case RF_EVENT_SLOTS:  return MAXEVENT;
+  default:              return 0;
+  }
+}
+
+// refreshRegisters: update all registers of the given source in the register image
+void refreshRegisters(RegSource src) {
+  for (const RegDescriptor& r : REGISTERS) {
+    if (r.source == src) {
+      if (r.encoding == RE_FLOAT) {
+        setImageFloat(r.address, fieldFloat(r));
+      } else {
+        setImage(r.address, fieldWord(r));
+      }
+    }
+  }
+}
+
+// refreshInputs: update the input register block
+void refreshInputs() {
+  setInput(IR_SEQUENCE, measureSeq);
+  for (uint8_t i = 0; i < 2; i++) {
+    mySensor& ms = i ? DHT1 : DHT0;
+    uint16_t a = i ? IR_S1_TEMP : IR_S0_TEMP;
+    // Sensors not in use have no values
+    bool used = (settings.sensor[i].type != DEV_NONE);
+    setInput(a, used ? toFixed(ms.th.temperature) : IR_INVALID);
+    setInput(a + 1, used ? toFixed(ms.th.humidity) : IR_INVALID);
+    setInput(a + 2, used ? toFixed(ms.dewPoint) : IR_INVALID);
+  }
+  setInput(IR_SWITCHED, switchedON ? 1 : 0);
+  setInput(IR_S0_HEALTH, DHT0.healthTracker);
+  setInput(IR_S1_HEALTH, DHT1.healthTracker);
+  setInput(IR_TARGET_HEALTH, targetHealth);
+  setInput(IR_CSTATE, cState);
+  setInput(IR_RUNTIME, runTime);
+}
+
+// refreshMeasured: update measurement, target and health registers
+inline void refreshMeasured() { refreshRegisters(RS_MEASURED); refreshInputs(); }
+
+// refreshCounters: update restart count, run time and the current history slot
+inline void refreshCounters() { refreshRegisters(RS_COUNTER); setInput(IR_RUNTIME, runTime); }
+
+// refreshSettings: update all registers derived from the settings
+inline void refreshSettings() { refreshRegisters(RS_SETTING); }
+
+// refreshEvents: update the event registers REG_EVENTS..REG_EVENTS + MAXEVENT - 1
+void refreshEvents() {
+  RingBuf<uint16_t, MAXEVENT>::Span first, second;
+  events.data(first, second);
+  uint16_t a = REG_EVENTS;
+  for (size_t i = 0; i < first.len; i++) {
+    setImage(a++, first.ptr[i]);
+  }
+  for (size_t i = 0; i < second.len; i++) {
+    setImage(a++, second.ptr[i]);
+  }
+  // Unused event slots are 0
+  while (a < REG_EVENTS + MAXEVENT) {
+    setImage(a++, 0);
+  }
+}
+
+// refreshErrors: update the error tracking registers, newest error first
+void refreshErrors() {
+  for (uint16_t relIndex = 0; relIndex < TTslots; relIndex++) {
+    // Calculate slot. We may have to go back and around!
+    uint16_t slot = (ttSlot + TTslots - relIndex) % TTslots;
+    setImage(REG_ERRORS + relIndex * 2, (uint16_t)targetTrack[slot].err);
+    setImage(REG_ERRORS + relIndex * 2 + 1, targetTrack[slot].count);
+  }
+}
+
+// refreshRtt: update the round trip statistics registers of a remote device (0: S0, 1: S1, 2: target)
+void refreshRtt(uint8_t dev) {
+  uint16_t a = REG_RTT + dev * RR_WORDS;
+  setImage(a + RR_COUNT, rtt[dev].count());
+  setImage(a + RR_TIMEOUTS, rtt[dev].timeouts());
+  setImage(a + RR_MIN, rtt[dev].minimum());
+  setImage(a + RR_AVG, rtt[dev].average());
+  setImage(a + RR_MAX, rtt[dev].maximum());
+  setImage(a + RR_P95, rtt[dev].p95());
+}
+
+// refreshImage: build the complete register image
+void refreshImage() {
+  memset(regImage, 0, sizeof(regImage));
+  memset(inputImage, 0, sizeof(inputImage));
+  // Constant values
+  refreshRegisters(RS_CONST);
+  setImage(REG_ERRORCOUNT, TTslots);
+  refreshMeasured();
+  refreshCounters();
+  refreshSettings();
+  refreshEvents();
+  refreshErrors();
+  for (uint8_t dev = 0; dev < 3; dev++) {
+    refreshRtt(dev);
+  }
+}
+
 // Keep track of Modbus error responses
 void registerMBerror(Modbus::Error e) {
   // Only sensible if we have slots at all
@@ -424,6 +734,8 @@ void registerMBerror(Modbus::Error e) {
       if (targetTrack[ttSlot].count < 65535) {
         // Yes. Increase counter
         targetTrack[ttSlot].count++;
+        // Only the newest count register has changed
+        setImage(REG_ERRORS + 1, targetTrack[ttSlot].count);
       }
     } else {
       // No it is different. Advanvce index
@@ -436,113 +748,435 @@ void registerMBerror(Modbus::Error e) {
       // Write error and init count
       targetTrack[ttSlot].err = e;
       targetTrack[ttSlot].count = 1;
+      // All slots have moved
+      refreshErrors();
     }
   }
 }
 
-// Number of event slots
-const uint8_t MAXEVENT(40);
-// Define the event types
-enum S_EVENT : uint8_t  { 
-  NO_EVENT=0, DATE_CHANGE,
-  BOOT_DATE, BOOT_TIME, 
-  MASTER_ON, MASTER_OFF,
-  TARGET_ON, TARGET_OFF,
-  ENTER_MAN, EXIT_MAN,
-  FAIL_FB,
-};
-const char *eventname[] = { 
-  "no event", "date change", "boot date", "boot time", 
-  "MASTER on", "MASTER off", 
-  "target on", "target off", 
-  "enter manual", "exit manual",
-  "failure fallback",
-};
-// Allocate event buffer
-RingBuf<uint16_t> events(MAXEVENT);
 
 // Server for own data
 ModbusServerTCPasync MBserver;
-// Modbus server ID
+// Modbus server ID and port
 const uint8_t MYSID(1);
-// Client to access switch and sensor sources
-ModbusClientTCPasync MBclient(10);
+const uint16_t MYPORT(502);
+// Clients to access switch and sensor sources, one per endpoint
+ClientPool clients;
+const uint32_t CLIENT_TIMEOUT(10000);       // ms to wait for a response
+const uint32_t CLIENT_IDLE(65000);          // ms to keep an unused connection open
+// Request kinds, part of the request tokens (see ClientPool.h)
+enum REQKIND : uint8_t {
+  RK_SENSOR = 0x10,                         // 0x10, 0x11: sensor 0 or 1 data poll
+  RK_SENSORS = 0x14,                        // 0x14..0x17: combined poll for both sensors, source slots in bits 1 and 0
+  RK_TARGET_READ = 0x20,                    // Target state poll
+  RK_TARGET_WRITE = 0x21,                   // Target switch
+  RK_PUSH = 0x30,                           // 0x30 + n: push to subscriber n
+  RK_SUBSCRIBE = 0x40,                      // 0x40, 0x41: subscription for sensor 0 or 1
+};
 
-// checkSensor: test if physical sensor is functional
-int checkSensor(mySensor& ms) {
-  int rc = -1;
+// Request policy for the remote devices (0: S0 source, 1: S1 source, 2: target).
+// Response timeouts follow the round trip times seen. Failed requests are retried a few times
+// with growing, jittered delays. A device failing all retries several times in a row is regarded
+// down and is left alone for a backoff time, doubled with each further failure.
+const uint32_t TIMEOUT_MIN(1000);           // ms lower limit of a response timeout
+const uint8_t RETRY_MAX(2);                 // Retries per request
+const uint32_t RETRY_DELAY(500);            // ms before the first retry, doubled for each further one
+const uint32_t RETRY_JITTER(250);           // ms random delay added to a retry
+const uint8_t BACKOFF_AFTER(2);             // Requests failed in a row before backing off
+const uint32_t BACKOFF_BASE(30000);         // ms of the first backoff
+const uint32_t BACKOFF_MAX(900000);         // ms upper limit of the backoff
+struct RemotePolicy {
+  uint8_t retries;                          // Retries done for the current request
+  uint8_t fails;                            // Requests failed in a row after all retries
+  bool retryPending;                        // A retry is scheduled
+  uint32_t retryAt;                         // Time the retry is due
+  uint32_t backoffUntil;                    // No requests before this time while the device is down
+  RemotePolicy() : retries(0), fails(0), retryPending(false), retryAt(0), backoffUntil(0) {}
+};
+RemotePolicy policy[3];
+int8_t retryTaskID = -1;                    // Scheduler ID of retryTask
+bool targetWanted = false;                  // Switch state last requested from a Modbus target
+
+// requestTimeout: response timeout for a remote device
+inline uint32_t requestTimeout(uint8_t dev) {
+  return rtt[dev].suggestTimeout(TIMEOUT_MIN, CLIENT_TIMEOUT);
+}
+
+// remoteDown: true if a remote device is regarded down and shall not be bothered now
+bool remoteDown(uint8_t dev) {
+  return policy[dev].fails >= BACKOFF_AFTER && (int32_t)(millis() - policy[dev].backoffUntil) < 0;
+}
+
+// remoteOK: note a successful request to a remote device
+void remoteOK(uint8_t dev) {
+  if (policy[dev].fails >= BACKOFF_AFTER) {
+    LOG_I("Remote device %u is back\n", dev);
+  }
+  policy[dev].retries = 0;
+  policy[dev].fails = 0;
+}
+
+// remoteGaveUp: note a request to a remote device that failed finally, backing off if it failed too often
+void remoteGaveUp(uint8_t dev) {
+  RemotePolicy& p = policy[dev];
+  p.retries = 0;
+  if (p.fails < 255) {
+    p.fails++;
+  }
+  if (p.fails >= BACKOFF_AFTER) {
+    uint8_t n = p.fails - BACKOFF_AFTER;
+    uint32_t backoff = (n < 5) ? (BACKOFF_BASE << n) : BACKOFF_MAX;
+    if (backoff > BACKOFF_MAX) {
+      backoff = BACKOFF_MAX;
+    }
+    p.backoffUntil = millis() + backoff;
+    LOG_W("Remote device %u down, backing off for %us\n", dev, backoff / 1000);
+  }
+}
+
+// scheduleRetry: plan another try of a failed request, if the error, the retries left
+// and the time left (in ms) allow for one. Returns false if the request has failed finally.
+bool scheduleRetry(uint8_t dev, Error e, uint32_t timeLeft) {
+  RemotePolicy& p = policy[dev];
+  // Only requests without an answer are worth a retry. An error response would come again.
+  if (e < TIMEOUT || p.retries >= RETRY_MAX) {
+    return false;
+  }
+  // Will the retry be answered in time?
+  uint32_t delay = (RETRY_DELAY << p.retries) + random(RETRY_JITTER);
+  if (delay + requestTimeout(dev) > timeLeft) {
+    // No.
+    return false;
+  }
+  p.retries++;
+  p.retryAt = millis() + delay;
+  p.retryPending = true;
+  LOG_W("Remote device %u: retry %u in %ums\n", dev, p.retries, delay);
+  // Start the retry task for the earliest retry due
+  uint32_t next = delay;
+  for (uint8_t d = 0; d < 3; d++) {
+    if (policy[d].retryPending) {
+      int32_t due = policy[d].retryAt - millis();
+      if (due < 0) due = 0;
+      if ((uint32_t)due < next) next = due;
+    }
+  }
+  tasks.reschedule(retryTaskID, next);
+  return true;
+}
+
+// Sensor data subscriptions.
+// A device with a Modbus sensor source subscribes to it (FC41). The source then will push (FC42)
+// each fresh reading of its local sensor to all subscribers. If the pushes stop, the subscriber
+// falls back to polling the source and tries to subscribe again.
+Subscribers subscribers;                    // Subscriptions to our own local sensors
+const uint16_t SUBSCRIBE_LEASE(600);        // Lease time in seconds requested for a subscription
+const uint32_t SUBSCRIBE_RETRY(300000);     // ms between subscription attempts while polling
+const uint32_t PUSH_GRACE(5000);            // ms a push may be late before the data is regarded stale
+
+// sourceTag: fingerprint of a sensor's Modbus source. Pushes are only accepted with a matching tag,
+// so those of a previously configured source will be ignored.
+uint16_t sourceTag(SetData::SensorData& sd) {
+  return ((sd.IP[2] << 8) | sd.IP[3]) ^ (uint16_t)sd.port ^ (((uint8_t)sd.SID << 8) | (sd.slot ? 1 : 0));
+}
+
+// subscribeSensor: request the Modbus source of a sensor to push its readings to us
+void subscribeSensor(mySensor& ms) {
+  SetData::SensorData& sd = settings.sensor[ms.sensor01];
+  IPAddress myIP = WiFi.localIP();
+  ModbusMessage request;
+
+  // Source slot, our sensor index and tag, our address and the lease time requested
+  request.add((uint8_t)sd.SID, USER_DEFINED_41, (uint8_t)(sd.slot ? 1 : 0), ms.sensor01, sourceTag(sd));
+  for (uint8_t i = 0; i < 4; i++) {
+    request.add((uint8_t)myIP[i]);
+  }
+  request.add(MYPORT, MYSID, SUBSCRIBE_LEASE);
+  Error e = clients.addRequest(sd.IP, sd.port, RK_SUBSCRIBE | ms.sensor01, request);
+  if (e != SUCCESS) {
+    ModbusError me(e);
+    LOG_E("Error subscribing sensor %d - %s\n", ms.sensor01, (const char *)me);
+  }
+  ms.lastSubscribe = millis();
+}
+
+// Pushes not sent yet, one bit per subscriber. These are waiting for a free client.
+uint16_t pushPending = 0;
+int8_t pushTaskID = -1;                     // Scheduler ID of pushTask
+const uint32_t PUSH_RETRY(200);             // ms to wait for a free client
+
+// pushTask: send all pending pushes. Those that found no free client are tried again later.
+void pushTask() {
+  for (uint8_t i = 0; i < SUBSCRIBERS_MAX; i++) {
+    if (pushPending & (1 << i)) {
+      const Subscription *sub = subscribers.get(i);
+      // Subscription may have run out in the meantime
+      if (sub) {
+        mySensor& ms = sub->slot ? DHT1 : DHT0;
+        ModbusMessage request;
+        request.add(sub->SID, USER_DEFINED_42, sub->index, sub->tag, ms.pubSeq, settings.measuringInterval);
+        request.add(ms.th.temperature, ms.th.humidity, ms.dewPoint);
+        Error e = clients.addRequest(sub->ip, sub->port, RK_PUSH + i, request);
+        // All clients busy? Keep it for the next turn
+        if (e == REQUEST_QUEUE_FULL) continue;
+        if (e != SUCCESS) {
+          ModbusError me(e);
+          LOG_E("Error pushing sensor %d to subscriber %u - %s\n", sub->slot, i, (const char *)me);
+          subscribers.pushed(i, false);
+        }
+      }
+      pushPending &= ~(1 << i);
+    }
+  }
+  if (pushPending) {
+    tasks.reschedule(pushTaskID, PUSH_RETRY);
+  }
+}
+
+// publishSensor: push a fresh reading of a local sensor to all its subscribers
+void publishSensor(mySensor& ms) {
+  ms.pubSeq++;
+  for (uint8_t i = 0; i < SUBSCRIBERS_MAX; i++) {
+    const Subscription *sub = subscribers.get(i);
+    if (sub && sub->slot == ms.sensor01) {
+      pushPending |= (1 << i);
+    }
+  }
+  pushTask();
+}
+
+// Measurement cycle: the conditions are evaluated when all expected readings have arrived
+const uint32_t MEASURE_DEADLINE(CLIENT_TIMEOUT + 1000);  // ms to wait for the readings at most
+uint8_t measurePending = 0;                 // Readings still expected, bit 0: S0, bit 1: S1
+uint32_t cycleStart = 0;                    // Time the running measurement cycle was started
+int8_t evaluateTaskID = -1;                 // Scheduler ID of evaluateTask
+
+// measureArrived: note a reading (or its failure) for the running measurement cycle
+void measureArrived(mySensor& ms) {
+  // Was the reading expected?
+  if (measurePending & (1 << ms.sensor01)) {
+    // Yes. Evaluate right away if it was the last one
+    measurePending &= ~(1 << ms.sensor01);
+    if (!measurePending) {
+      tasks.reschedule(evaluateTaskID, 0);
+    }
+  }
+}
+
+// sensorRead: callback for finished reads of the physical sensors
+void sensorRead(DHTasync& dht, void *arg) {
+  mySensor& ms = *static_cast<mySensor *>(arg);
 
   // advance health tracker
   ms.healthTracker <<= 1;
-  // The DHT lib will return nan values if no sensor is present
-  if (!isnan(ms.sensor.getTemperature())) {
+  // A measurement takes the values in any case, a check only if there are some
+  if (!ms.checking || dht.getStatus() == DHT_OK) {
+    ms.th = dht.getTempAndHumidity();
+    ms.dewPoint = DHTasync::computeDewPoint(ms.th.temperature, ms.th.humidity);
+  }
+  if (dht.getStatus() == DHT_OK) {
     // We got a value - sensor seems to be functional
-    LOG_I("Sensor %u ok.\n", ms.sensor01);
+    if (ms.checking) {
+      LOG_I("Sensor %u ok.\n", ms.sensor01);
+    }
     ms.healthTracker |= 1;
     // Light upper status LED
     ms.statusLED.start(DEVICE_OK);
     ms.lastCheckOK = true;
-    rc = 0;
+    // A fresh measurement goes to the subscribers
+    if (!ms.checking) {
+      publishSensor(ms);
+    }
   } else {
-    // We caught a nan.
-    LOG_E("Sensor %u: error %s\n", ms.sensor01, ms.sensor.getStatusString());
-    // Turn off status LED
-    ms.statusLED.start(DEVICE_IGNORED);
+    LOG_E("Sensor %u: error %s\n", ms.sensor01, dht.getStatusString());
+    // Turn off status LED for a failed check, let it blink for a failed measurement
+    ms.statusLED.start(ms.checking ? DEVICE_IGNORED : DEVICE_ERROR_BLINK);
     ms.lastCheckOK = false;
   }
+  ms.checking = false;
+  refreshMeasured();
+  measureArrived(ms);
+}
+
+// checkSensor: test if physical sensor is functional
+// The result will be known after the read has finished (see sensorRead())
+int checkSensor(mySensor& ms) {
+  int rc = -1;
+
+  if (ms.sensor.start()) {
+    ms.checking = true;
+    rc = 0;
+  } else {
+    LOG_W("Sensor %u busy, not checked\n", ms.sensor01);
+  }
   return rc;
 }
 
-// takeMeasurement: get temperature, humidity and dew point for a sensor
-// If no sensor is connected, try to get data from Modbus source
+// Registers read from a Modbus sensor source: temperature, humidity and dew point
+const uint16_t REMOTE_WORDS(regAddress(RF_VALUE_DEW) + 2 - regAddress(RF_VALUE_TEMP));
+
+// remoteAddress: first register of a sensor's data on its Modbus source
+inline uint16_t remoteAddress(SetData::SensorData& sd) {
+  return regAddress(RF_VALUE_TEMP, sd.slot ? 1 : 0);
+}
+
+// remoteFailed: count a failed poll of a sensor's Modbus source
+void remoteFailed(mySensor& ms) {
+  ms.healthTracker <<= 1;
+  ms.statusLED.start(DEVICE_ERROR_BLINK);
+  ms.lastCheckOK = false;
+  measureArrived(ms);
+}
+
+// remoteDue: check if the Modbus source of a sensor has to be polled.
+// Readings pushed in time make polling unnecessary - then only the subscription is renewed when needed.
+bool remoteDue(mySensor& ms) {
+  uint32_t now = millis();
+
+  // Are the readings pushed to us in time?
+  if (ms.pushInterval && now - ms.lastPush < ms.pushInterval * 2000UL + PUSH_GRACE) {
+    // Yes. No need to poll, only renew the subscription when half of the lease has passed
+    if (now - ms.lastSubscribe >= SUBSCRIBE_LEASE * 500UL) {
+      subscribeSensor(ms);
+    }
+    return false;
+  }
+  // No. Have the pushes stopped?
+  if (ms.pushInterval) {
+    // Yes. The source may have been restarted - try to subscribe again right away
+    LOG_W("Sensor %u: pushes stopped, polling\n", ms.sensor01);
+    ms.pushInterval = 0;
+    ms.lastSubscribe = 0;
+  }
+  // Try to subscribe from time to time - the source may not support it
+  if (ms.lastSubscribe == 0 || now - ms.lastSubscribe >= SUBSCRIBE_RETRY) {
+    subscribeSensor(ms);
+  }
+  return true;
+}
+
+// sendSensorPoll: request the data of a single sensor from its Modbus source
+Error sendSensorPoll(uint8_t i) {
+  SetData::SensorData& sd = settings.sensor[i];
+  clients.setTimeout(sd.IP, sd.port, requestTimeout(i));
+  Error e = clients.addRequest(sd.IP, sd.port, RK_SENSOR | i,
+    sd.SID, READ_HOLD_REGISTER, remoteAddress(sd), REMOTE_WORDS);
+  if (e != SUCCESS) {
+    ModbusError me(e);
+    LOG_E("Error requesting sensor %d - %s\n", i, (const char *)me);
+    registerMBerror(e);
+  }
+  return e;
+}
+
+// retrySensor: retry a failed sensor poll within the running measurement cycle, or count the failure
+void retrySensor(uint8_t i, Error e) {
+  uint32_t used = millis() - cycleStart;
+  uint32_t timeLeft = ((measurePending & (1 << i)) && used < MEASURE_DEADLINE) ? MEASURE_DEADLINE - used : 0;
+  if (!scheduleRetry(i, e, timeLeft)) {
+    remoteGaveUp(i);
+    remoteFailed(i ? DHT1 : DHT0);
+  }
+}
+
+// pollRemoteSensors: request the data of all sensors with a Modbus source.
+// If both sensors are read from the same source device, a single request will cover both.
+// That saves a request and gives readings of the same moment for the difference conditions.
+// The requests are asynchronous, the data will arrive in handleData().
+// Returns a bit mask of the sensors a request has been sent for (bit 0: S0, bit 1: S1).
+uint8_t pollRemoteSensors() {
+  uint8_t sent = 0;
+  bool due[2] = { false, false };
+  bool failed = false;
+
+  // Find out which sensors need a poll
+  for (uint8_t i = 0; i < 2; i++) {
+    SetData::SensorData& sd = settings.sensor[i];
+    mySensor& ms = i ? DHT1 : DHT0;
+    // Retries of the previous cycle are obsolete now
+    policy[i].retryPending = false;
+    policy[i].retries = 0;
+    if (sd.type == DEV_MODBUS) {
+      // Is Modbus address set?
+      if (sd.IP && sd.port && sd.SID) {
+        due[i] = remoteDue(ms);
+        // Is the source down? Then do not waste a request on it
+        if (due[i] && remoteDown(i)) {
+          LOG_V("Sensor %u source down, not polled\n", i);
+          due[i] = false;
+          remoteFailed(ms);
+          failed = true;
+        }
+      } else {
+        // No, count as failure
+        remoteFailed(ms);
+        failed = true;
+      }
+    }
+  }
+
+  SetData::SensorData& sd0 = settings.sensor[0];
+  SetData::SensorData& sd1 = settings.sensor[1];
+  // Both due and on the same source device?
+  if (due[0] && due[1] && sd0.IP == sd1.IP && (uint16_t)sd0.port == (uint16_t)sd1.port && (uint8_t)sd0.SID == (uint8_t)sd1.SID) {
+    // Yes. Read the register range covering both
+    uint16_t a0 = remoteAddress(sd0);
+    uint16_t a1 = remoteAddress(sd1);
+    uint16_t start = (a0 < a1) ? a0 : a1;
+    uint16_t words = ((a0 < a1) ? a1 : a0) + REMOTE_WORDS - start;
+    uint32_t t0 = requestTimeout(0);
+    uint32_t t1 = requestTimeout(1);
+    clients.setTimeout(sd0.IP, sd0.port, (t0 > t1) ? t0 : t1);
+    Error e = clients.addRequest(sd0.IP, sd0.port, RK_SENSORS | (sd0.slot ? 2 : 0) | (sd1.slot ? 1 : 0),
+      sd0.SID, READ_HOLD_REGISTER, start, words);
+    if (e != SUCCESS) {
+      ModbusError me(e);
+      LOG_E("Error requesting sensors - %s\n", (const char *)me);
+      registerMBerror(e);
+      remoteFailed(DHT0);
+      remoteFailed(DHT1);
+      failed = true;
+    } else {
+      sent = 3;
+    }
+  } else {
+    // No, separate requests
+    for (uint8_t i = 0; i < 2; i++) {
+      if (due[i]) {
+        if (sendSensorPoll(i) != SUCCESS) {
+          remoteFailed(i ? DHT1 : DHT0);
+          failed = true;
+        } else {
+          sent |= (1 << i);
+        }
+      }
+    }
+  }
+  if (failed) {
+    refreshMeasured();
+  }
+  return sent;
+}
+
+// takeMeasurement: start a read of a physical sensor
+// The result will be known after the read has finished (see sensorRead()).
+// Sensors with a Modbus source are polled by pollRemoteSensors() instead.
+// Returns true if a fresh reading is on its way.
 bool takeMeasurement(mySensor& ms) {
   bool rc = false;
-  SetData::SensorData& sd = settings.sensor[ms.sensor01];
 
   // Physical sensor configured?
-  if (sd.type == DEV_LOCAL) {
-    ms.healthTracker <<= 1;
-    // Yes. get the data
-    ms.th = ms.sensor.getTempAndHumidity();
-    ms.dewPoint = ms.sensor.computeDewPoint(ms.th.temperature, ms.th.humidity);
-    // update status
-    if (!isnan(ms.th.temperature)) {
+  if (settings.sensor[ms.sensor01].type == DEV_LOCAL) {
+    // Yes. Start a read.
+    if (ms.sensor.start()) {
+      ms.checking = false;
+      rc = true;
+    } else if (ms.checking) {
+      // A sensor check is waiting or running - take its reading for this cycle
+      ms.checking = false;
       rc = true;
-      ms.healthTracker |= 1;
-      ms.statusLED.start(DEVICE_OK);
-      ms.lastCheckOK = true;
     } else {
-      ms.statusLED.start(DEVICE_ERROR_BLINK);
-      ms.lastCheckOK = false;
-    }
-  // No, but a Modbus source perhaps?
-  } else if (sd.type == DEV_MODBUS) {
-    // Yes. Check Modbus
-    // Is Modbus address set?
-    if (sd.IP && sd.port && sd.SID) {
-      // Yes. Set target and send a request
-      // This will be asynchronous, so we may use the previous data for now.
-      // MBclient.connect(sd.IP, sd.port);
-      MBclient.setTarget(sd.IP, sd.port);
-      Error e = MBclient.addRequest((uint32_t)((millis() << 16) | (0x1008 | ms.sensor01)), 
-        sd.SID, 
-        READ_HOLD_REGISTER,
-        (uint16_t)(sd.slot ? 8 : 2),  // Register address slot 1:2, slot 2:2 + 6 = 8
-        (uint16_t)6);
-      if (e != SUCCESS) {
-        ModbusError me(e);
-        LOG_E("Error requesting sensor %d - %s\n", ms.sensor01, (const char *)me);
-        registerMBerror(e);
-        ms.lastCheckOK = false;
-      } else {
-        rc = true;
-      }
-    } 
-    // Request sent?
-    if (!rc) {
-      // No, count as failure
-      ms.healthTracker <<= 1;
-      ms.statusLED.start(DEVICE_ERROR_BLINK);
+      LOG_W("Sensor %u busy, using previous data\n", ms.sensor01);
     }
   }
   return rc;
@@ -574,6 +1208,7 @@ void registerEvent(S_EVENT ev) {
   if (events[events.size() - 1] != eventWord) {
     // Push the word
     events.push_back(eventWord);
+    refreshEvents();
   }
 }
 
@@ -689,9 +1324,31 @@ void writeDeviceInfo() {
   LOG_V("deviceInfo=%d\n", deviceInfo.length());
 }
 
-// Helper function to pack some Modbus register values
-uint16_t makeCompact(uint8_t type, uint16_t value) {
-  return ((type & 0x03)  << 14) | (value & 0x0FFF);
+// commitTask: write changed settings to flash
+void commitTask() {
+  if (settingsDirty) {
+    settingsDirty = false;
+    writeSettings();
+    writeDeviceInfo();
+    // The commit register has changed
+    refreshSettings();
+  }
+}
+
+// scheduleCommit: mark the settings dirty and (re)start the quiet period
+void scheduleCommit(bool now) {
+  uint32_t t = millis();
+  // First change since the last commit?
+  if (!settingsDirty) {
+    settingsDirty = true;
+    dirtySince = t;
+  }
+  if (now) {
+    services.reschedule(commitTaskID, 0);
+  } else if (t - dirtySince < COMMIT_MAXDELAY) {
+    services.reschedule(commitTaskID, COMMIT_QUIET);
+  }
+  // else: do not postpone any more, the pending commit is due within COMMIT_QUIET
 }
 
 // Modbus server READ_HOLD_REGISTER callback
@@ -706,210 +1363,13 @@ ModbusMessage FC03(ModbusMessage request) {
   request.get(4, words);
 
   // Valid address etc.?
-  if (address && words && address + words <= 65 + MAXEVENT + 1 + TTslots * 2) {
+  if (address && words && words <= 125 && address + words <= REG_END) {
     // Yes, looks good. Prepare response header
     response.add(request.getServerID(), request.getFunctionCode(), (uint8_t)(words * 2));
-    // Temporary buffer for uint16_t manipulations
-    uint16_t uVal;
-    // We may need the float measurement values, so prepare a Modbus-compliant format
-    ModbusMessage fVal;
-    if (address <= 13 && 2 <= address + words - 1) {
-      fVal.add(DHT0.th.temperature);
-      fVal.add(DHT0.th.humidity);
-      fVal.add(DHT0.dewPoint);
-      fVal.add(DHT1.th.temperature);
-      fVal.add(DHT1.th.humidity);
-      fVal.add(DHT1.dewPoint);
-    }
-
-    // Loop over all requested addresses
-    for (uint16_t a = address; a < address + words; a++) {
-      switch (a) {
-      case  1: // Master switch
-        uVal = settings.masterSwitch ? 1 : 0;
-        response.add(uVal);
-        break;
-      case  2: // S0 temperature upper word
-      case  3: // S0 temperature lower word
-      case  4: // S0 humidity upper word
-      case  5: // S0 humidity lower word
-      case  6: // S0 dew point upper word
-      case  7: // S0 dew point lower word
-      case  8: // S1 temperature upper word
-      case  9: // S1 temperature lower word
-      case 10: // S1 humidity upper word
-      case 11: // S1 humidity lower word
-      case 12: // S1 dew point upper word
-      case 13: // S1 dew point lower word
-        // Get word from prepared buffer
-        fVal.get((a - 2) * 2, uVal);
-        response.add(uVal);
-        break;
-      case 14: // Target switch state
-        uVal = switchedON ? 1 : 0;
-        response.add(uVal);
-        break;
-      case 15: // restart count
-        response.add(restarts);
-        break;
-      case 16: // run time since boot
-        response.add(runTime);
-        break;
-      case 17: // S0 health
-        response.add(DHT0.healthTracker);
-        break;
-      case 18: // S1 health
-        response.add(DHT1.healthTracker);
-        break;
-      case 19: // target health
-        response.add(targetHealth);
-        break;
-      case 20: // measurement interval
-        response.add(settings.measuringInterval);
-        break;
-      case 21: // hysteresis steps
-        response.add((uint16_t)settings.hystSteps);
-        break;
-      case 22: // S0 type
-        response.add((uint16_t)settings.sensor[0].type);
-        break;
-      case 23: // S0 Modbus IP bytes 0, 1
-        uVal = (settings.sensor[0].IP[0] << 8) | settings.sensor[0].IP[1];
-        response.add(uVal);
-        break;
-      case 24: // S0 Modbus IP bytes 2, 3
-        uVal = (settings.sensor[0].IP[2] << 8) | settings.sensor[0].IP[3];
-        response.add(uVal);
-        break;
-      case 25: // S0 Modbus port
-        response.add(settings.sensor[0].port);
-        break;
-      case 26: // S0 Modbus SID and slot
-        uVal = (settings.sensor[0].SID << 8) | settings.sensor[0].slot;
-        response.add(uVal);
-        break;
-      case 27: // S0 temperature condition and value
-        uVal = int(settings.sensor[0].Temp * 10) + 2048;
-        response.add(makeCompact(settings.sensor[0].TempMode, uVal));
-        break;
-      case 28: // S0 humidity condition and value
-        uVal = int(settings.sensor[0].Hum * 10) + 2048;
-        response.add(makeCompact(settings.sensor[0].HumMode, uVal));
-        break;
-      case 29: // S0 dew point condition and value
-        uVal = int(settings.sensor[0].Dew * 10) + 2048;
-        response.add(makeCompact(settings.sensor[0].DewMode, uVal));
-        break;
-      case 30: // S1 type
-        response.add((uint16_t)settings.sensor[1].type);
-        break;
-      case 31: // S1 Modbus IP bytes 0, 1
-        uVal = (settings.sensor[1].IP[0] << 8) | settings.sensor[1].IP[1];
-        response.add(uVal);
-        break;
-      case 32: // S1 Modbus IP bytes 2, 3
-        uVal = (settings.sensor[1].IP[2] << 8) | settings.sensor[1].IP[3];
-        response.add(uVal);
-        break;
-      case 33: // S1 Modbus port
-        response.add(settings.sensor[1].port);
-        break;
-      case 34: // S1 Modbus SID and slot
-        uVal = (settings.sensor[1].SID << 8) | settings.sensor[1].slot;
-        response.add(uVal);
-        break;
-      case 35: // S1 temperature condition and value
-        uVal = int(settings.sensor[1].Temp * 10) + 2048;
-        response.add(makeCompact(settings.sensor[1].TempMode, uVal));
-        break;
-      case 36: // S1 humidity condition and value
-        uVal = int(settings.sensor[1].Hum * 10) + 2048;
-        response.add(makeCompact(settings.sensor[1].HumMode, uVal));
-        break;
-      case 37: // S1 dew point condition and value
-        uVal = int(settings.sensor[1].Dew * 10) + 2048;
-        response.add(makeCompact(settings.sensor[1].DewMode, uVal));
-        break;
-      case 38: // Target type
-        uVal = settings.Target;
-        response.add(uVal);
-        break;
-      case 39: // target Modbus IP bytes 0, 1
-        uVal = (settings.targetIP[0] << 8) | settings.targetIP[1];
-        response.add(uVal);
-        break;
-      case 40: // target Modbus IP bytes 2, 3
-        uVal = (settings.targetIP[2] << 8) | settings.targetIP[3];
-        response.add(uVal);
-        break;
-      case 41: // target Modbus port
-        response.add(settings.targetPort);
-        break;
-      case 42: // target Modbus SID
-        uVal = settings.targetSID << 8;
-        response.add(uVal);
-        break;
-      case 43: // combo temperature condition type and value
-        uVal = int(settings.Temp * 10) + 2048;
-        response.add(makeCompact(settings.TempDiff, uVal));
-        break;
-      case 44: // combo humidity condition type and value
-        uVal = int(settings.Hum * 10) + 2048;
-        response.add(makeCompact(settings.HumDiff, uVal));
-        break;
-      case 45: // combo dew point condition type and value
-        uVal = int(settings.Dew * 10) + 2048;
-        response.add(makeCompact(settings.DewDiff, uVal));
-        break;
-      case 46: // current condition state
-        response.add(cState);
-        break;
-      case 47: // Fallback switch
-        uVal = settings.fallbackSwitch ? 1 : 0;
-        response.add(uVal);
-        break;
-      case 48: // history slot count
-        response.add((uint16_t)HistorySlots);
-        break;
-      case 49: // history start register address
-        response.add((uint16_t)HistoryAddress);
-        break;
-      case 50: // current history data slot written
-        response.add((uint16_t)calcHistory.calcSlot());
-        break;
-      // reserved register numbers left out
-      case 64: // event slot count
-        response.add((uint16_t)MAXEVENT);
-        break;
-      case 65 ... (65 + MAXEVENT - 1): // Events
-        response.add(events[a - 65]);
-        break;
-      case 65 + MAXEVENT: // Error tracking slots
-        response.add(TTslots);
-        break;
-      case 66 + MAXEVENT ... 65 + MAXEVENT + TTslots * 2: // Error tracking values
-        {
-          // Calculate index. Subtract start address and divide by two.
-          uint16_t relIndex = (a - (66 + MAXEVENT)) / 2;
-          // Now calculate slot from it. We may have to go back and around!
-          uint16_t slot = (ttSlot + TTslots - relIndex) % TTslots;
-          // Odd index (=count)?
-          if ((a - (66 + MAXEVENT)) & 1) {
-            // Yes. Return count
-            response.add(targetTrack[slot].count);
-          } else {
-            // No, error code requested
-            response.add((uint16_t)targetTrack[slot].err);
-          }
-        }
-        break;
-      default: // Reserve registers
-        response.add((uint16_t)0);
-        break;
-      }
-    }
+    // Copy the registers from the register image
+    response.add((const uint8_t *)(regImage + address), (uint16_t)(words * 2));
   // None of the regular registers, but is it in the history area?
-  } else if (HistorySlots && words && address >= HistoryAddress && (address + words) <= (HistoryAddress + 5 * HistorySlots)) {
+  } else if (HistorySlots && words && words <= 125 && address >= HistoryAddress && (address + words) <= (HistoryAddress + 5 * HistorySlots)) {
     // Yes, looks good. Prepare response header
     response.add(request.getServerID(), request.getFunctionCode(), (uint8_t)(words * 2));
     // Loop over all requested addresses
@@ -924,19 +1384,13 @@ ModbusMessage FC03(ModbusMessage request) {
       // Calculate index in history
       uint16_t offs = (a - HistoryAddress) % HistorySlots;
       switch (type) {
-      case 0: // temp0
-        response.add((uint16_t)history[offs].temp0);
-        break;
-      case 1: // hum0
-        response.add((uint16_t)history[offs].hum0);
-        break;
-      case 2: // temp1
-        response.add((uint16_t)history[offs].temp1);
+      case HV_TEMP0:
+      case HV_HUM0:
+      case HV_TEMP1:
+      case HV_HUM1:
+        response.add(history[offs].avg[type]);
         break;
-      case 3: // hum1
-        response.add((uint16_t)history[offs].hum1);
-        break;
-      case 4: // target ON
+      case HV_COUNT: // target ON
         response.add((uint16_t)history[offs].on);
         break;
       default: // why???
@@ -949,7 +1403,113 @@ ModbusMessage FC03(ModbusMessage request) {
     response.setError(request.getServerID(), request.getFunctionCode(), ILLEGAL_DATA_ADDRESS);
     LOG_V("Address error: addr=%d words=%d\n", address, words);
   }
-  return response;
+  return response;
+}
+
+// Modbus server READ_INPUT_REGISTER callback
+ModbusMessage FC04(ModbusMessage request) {
+  ModbusMessage response;          // returned response message
+
+  uint16_t address = 0;
+  uint16_t words = 0;
+
+  // Get start address and length for read
+  request.get(2, address);
+  request.get(4, words);
+
+  // Valid address etc.?
+  if (address && words && address + words <= IR_END) {
+    // Yes, copy the registers from the input register image
+    response.add(request.getServerID(), request.getFunctionCode(), (uint8_t)(words * 2));
+    response.add((const uint8_t *)(inputImage + address), (uint16_t)(words * 2));
+  } else {
+    // No. Return error message
+    response.setError(request.getServerID(), request.getFunctionCode(), ILLEGAL_DATA_ADDRESS);
+    LOG_V("Input address error: addr=%d words=%d\n", address, words);
+  }
+  return response;
+}
+
+// The register map has to match the choice lists
+static_assert(findRegister(regAddress(RF_TYPE, 0))->maxVal == DEV_RESERVED - 1, "Register map does not match DEVICEMODE");
+static_assert(COND_RESERVED == DEVC_RESERVED, "Register map does not match DEVICECOND");
+
+// setField: store a checked register value into the settings
+void setField(const RegDescriptor& r, uint16_t value) {
+  // Index 0 and 1 are the sensors, 2 the target or the combined conditions
+  bool isSensor = (r.index < 2);
+  SetData::SensorData& sd = settings.sensor[r.index & 1];
+  IPAddress& ip = isSensor ? sd.IP : settings.targetIP;
+  // Condition type and comparison value, in case we need it
+  DEVICECOND dc = (DEVICECOND)conditionType(value);
+  float fV = conditionValue(value);
+
+  switch (r.field) {
+  case RF_MASTER:
+    settings.masterSwitch = (value ? true : false);
+    registerEvent(settings.masterSwitch ? MASTER_ON : MASTER_OFF);
+    break;
+  case RF_INTERVAL:
+    settings.measuringInterval = value;
+    break;
+  case RF_HYSTERESIS:
+    settings.hystSteps = (value == 16 ? 0 : value);
+    break;
+  case RF_TYPE:
+    (isSensor ? sd.type : settings.Target) = (DEVICEMODE)value;
+    break;
+  case RF_IP:
+    {
+      uint8_t offs = (r.encoding == RE_IP_HI) ? 0 : 2;
+      ip[offs] = (value >> 8) & 0xFF;
+      ip[offs + 1] = value & 0xFF;
+    }
+    break;
+  case RF_PORT:
+    if (isSensor) sd.port = value;
+    else          settings.targetPort = value;
+    break;
+  case RF_SID:
+    if (isSensor) {
+      sd.SID = (value >> 8) & 0xFF;
+      sd.slot = ((value & 0xFF) ? true : false);
+    } else {
+      settings.targetSID = (value >> 8) & 0xFF;
+    }
+    break;
+  case RF_COND_TEMP:
+    if (isSensor) { sd.TempMode = dc; sd.Temp = fV; }
+    else          { settings.TempDiff = dc; settings.Temp = fV; }
+    break;
+  case RF_COND_HUM:
+    if (isSensor) { sd.HumMode = dc; sd.Hum = fV; }
+    else          { settings.HumDiff = dc; settings.Hum = fV; }
+    break;
+  case RF_COND_DEW:
+    if (isSensor) { sd.DewMode = dc; sd.Dew = fV; }
+    else          { settings.DewDiff = dc; settings.Dew = fV; }
+    break;
+  case RF_FALLBACK:
+    settings.fallbackSwitch = (value ? true : false);
+    break;
+  case RF_HIST_SLOTS:
+    settings.historySlots = value;
+    break;
+  case RF_COMMIT:
+    if (value) commitRequested = true;
+    break;
+  default:
+    break;
+  }
+}
+
+// applyHistorySlots: resize the history to the slots set
+void applyHistorySlots() {
+  if (!resizeHistory(settings.historySlots)) {
+    // Memory has gone in the meantime. Keep the old size
+    LOG_E("Could not allocate %u history slots\n", settings.historySlots);
+    settings.historySlots = HistorySlots;
+  }
 }
 
 // writeRegister: helper function to check a register address and data
@@ -957,176 +1517,23 @@ ModbusMessage FC03(ModbusMessage request) {
 Error writeRegister(uint16_t address, uint16_t value) {
   Error rc = SUCCESS;              // Function return value
 
-  // Check address range
-  if (address && address <= 65 + MAXEVENT) {
-    // Looks okay, address exists
-
-    // Calculate sensor slot, if needed
-    uint8_t sensor = (address >= 22 && address <= 29) ? 0 : 1;
-
-    // Calculate DEVICECOND and comparison values, in case we need it.
-    DEVICECOND dc = (DEVICECOND)(((value >> 14)) & 0x3);
-    float fV = ((value & 0x0FFF) - 2048) / 10.0;
-
-    // Examine address
-    switch (address) {
-    case 1: // Master switch
-      settings.masterSwitch = (value ? true : false);
-      registerEvent(settings.masterSwitch ? MASTER_ON : MASTER_OFF);
-      break;
-    case 20: // Measuring interval
-      // In range?
-      if (value >= 10 && value <= 3600) {
-        settings.measuringInterval = value;
-      } else {
-        rc = ILLEGAL_DATA_VALUE;
-      }
-      break;
-    case 21: // Hysteresis steps
-      // In range?
-      if (value >= 1 && value <= 16) {
-        settings.hystSteps = (value == 16 ? 0 : value);
-      } else {
-        rc = ILLEGAL_DATA_VALUE;
-      }
-      break;
-    case 22: // S0 type
-    case 30: // S1 
-      if (value < DEV_RESERVED) {
-        settings.sensor[sensor].type = (DEVICEMODE)value;
-      } else {
-        rc = ILLEGAL_DATA_VALUE;
-      }
-      break;
-    case 23: // S0 Modbus IP bytes 0, 1
-    case 31: // S1 
-      settings.sensor[sensor].IP[0] = (value >> 8) & 0xFF;
-      settings.sensor[sensor].IP[1] = value & 0xFF;
-      break;
-    case 24: // S0 Modbus IP bytes 2, 3
-    case 32: // S1 
-      settings.sensor[sensor].IP[2] = (value >> 8) & 0xFF;
-      settings.sensor[sensor].IP[3] = value & 0xFF;
-      break;
-    case 25: // S0 Modbus port
-    case 33: // S1 
-      if (value) {
-        settings.sensor[sensor].port = value;
-      } else {
-        rc = ILLEGAL_DATA_VALUE;
-      }
-      break;
-    case 26: // S0 Modbus SID and slot
-    case 34: // S1 
-      if (value) {
-        uint8_t SID = (value >> 8) & 0xFF;
-        uint8_t slot = value & 0xFF;
-        if (SID && SID <= 247 && slot < 2) {
-          settings.sensor[sensor].SID = SID;
-          settings.sensor[sensor].slot = (slot ? true : false);
-        } else {
-          rc = ILLEGAL_DATA_VALUE;
-        }
-      } else {
-        rc = ILLEGAL_DATA_VALUE;
-      }
-      break;
-    case 27: // S0 temperature condition and value
-    case 35: // S1 
-      if (dc != DEVC_RESERVED) {
-        settings.sensor[sensor].TempMode = dc;
-        settings.sensor[sensor].Temp = fV;
-      } else {
-        rc = ILLEGAL_DATA_VALUE;
-      }
-      break;
-    case 28: // S0 humidity condition and value
-    case 36: // S1 
-      if (dc != DEVC_RESERVED) {
-        settings.sensor[sensor].HumMode = dc;
-        settings.sensor[sensor].Hum = fV;
-      } else {
-        rc = ILLEGAL_DATA_VALUE;
-      }
-      break;
-    case 29: // S0 dew point condition and value
-    case 37: // S1 
-      if (dc != DEVC_RESERVED) {
-        settings.sensor[sensor].DewMode = dc;
-        settings.sensor[sensor].Dew = fV;
-      } else {
-        rc = ILLEGAL_DATA_VALUE;
-      }
-      break;
-    case 38: // Target type
-      if (value < DEV_RESERVED) {
-        settings.Target = (DEVICEMODE)value;
-      } else {
-        rc = ILLEGAL_DATA_VALUE;
-      }
-      break;
-    case 39: // Target Modbus IP bytes 0, 1
-      settings.targetIP[0] = (value >> 8) & 0xFF;
-      settings.targetIP[1] = value & 0xFF;
-      break;
-    case 40: // Target Modbus IP bytes 2, 3
-      settings.targetIP[2] = (value >> 8) & 0xFF;
-      settings.targetIP[3] = value & 0xFF;
-      break;
-    case 41: // Target Modbus port
-      if (value) {
-        settings.targetPort = value;
-      } else {
-        rc = ILLEGAL_DATA_VALUE;
-      }
-      break;
-    case 42: // Target Modbus SID
-      if (value) {
-        uint8_t SID = (value >> 8) & 0xFF;
-        if (SID && SID <= 247) {
-          settings.targetSID = SID;
-        } else {
-          rc = ILLEGAL_DATA_VALUE;
-        }
-      } else {
-        rc = ILLEGAL_DATA_VALUE;
-      }
-      break;
-    case 43: // Combo temperature condition and value
-      if (dc != DEVC_RESERVED) {
-        settings.TempDiff = dc;
-        settings.Temp = fV;
-      } else {
-        rc = ILLEGAL_DATA_VALUE;
-      }
-      break;
-    case 44: // Combo humidity condition and value
-      if (dc != DEVC_RESERVED) {
-        settings.HumDiff = dc;
-        settings.Hum = fV;
-      } else {
-        rc = ILLEGAL_DATA_VALUE;
-      }
-      break;
-    case 45: // Combo dew point condition and value
-      if (dc != DEVC_RESERVED) {
-        settings.DewDiff = dc;
-        settings.Dew = fV;
-      } else {
-        rc = ILLEGAL_DATA_VALUE;
-      }
-      break;
-    case 47: // fallback switch
-      settings.fallbackSwitch = (value ? true : false);
-      break;
-    default:
-      // If we end up here, the address is not write-enabled
-      rc = ILLEGAL_DATA_ADDRESS;
+  switch (checkWrite(address, value)) {
+  case RC_ADDRESS:
+    // address not writable or outside register range
+    rc = ILLEGAL_DATA_ADDRESS;
+    break;
+  case RC_VALUE:
+    rc = ILLEGAL_DATA_VALUE;
+    break;
+  default:
+    // All checks passed. A new history size needs the memory for it, though
+    if (findRegister(address)->field == RF_HIST_SLOTS && !historyFits(value)) {
+      rc = SERVER_DEVICE_FAILURE;
       break;
     }
-  } else {
-    // address outside register range
-    rc = ILLEGAL_DATA_ADDRESS;
+    // Write it
+    setField(*findRegister(address), value);
+    break;
   }
   LOG_V("RC=%02X @%d: %04X\n", rc, address, value);
   return rc;
@@ -1145,14 +1552,17 @@ ModbusMessage FC06(ModbusMessage request) {
   request.get(4, value);
 
   // Check address, data and write it in case all is OK
+  commitRequested = false;
   e = writeRegister(address, value);
 
   // Generate appropriate response message
   if (e == SUCCESS) {
     response = ECHO_RESPONSE;
-    // We need to write the settings!
-    writeSettings();
-    writeDeviceInfo();
+    // The history follows a change of its size at once
+    applyHistorySlots();
+    // The settings need to be written - but not right now
+    scheduleCommit(commitRequested);
+    refreshSettings();
   } else {
     response.setError(request.getServerID(), request.getFunctionCode(), e);
   }
@@ -1177,7 +1587,8 @@ ModbusMessage FC10(ModbusMessage request) {
   offs++;
 
   // Valid address etc.?
-  if (address && words && address + words <= 65 + MAXEVENT) {
+  commitRequested = false;
+  if (address && words && address + words <= REG_ERRORCOUNT) {
     // Yes. Loop over words to be written
     for (uint16_t i = 0; i < words; i++) {
       // Get next value
@@ -1197,9 +1608,11 @@ ModbusMessage FC10(ModbusMessage request) {
   // Generate appropriate response message
   if (e == SUCCESS) {
     response.add(request.getServerID(), request.getFunctionCode(), address, words);
-    // We need to write the settings!
-    writeSettings();
-    writeDeviceInfo();
+    // The history follows a change of its size at once
+    applyHistorySlots();
+    // The settings need to be written - but not right now
+    scheduleCommit(commitRequested);
+    refreshSettings();
   } else {
     response.setError(request.getServerID(), request.getFunctionCode(), e);
     // Roll back changes
@@ -1208,6 +1621,92 @@ ModbusMessage FC10(ModbusMessage request) {
   return response;
 }
 
+// Modbus server SUBSCRIBE callback: a remote device wants the readings of a local sensor pushed to it
+// Request data: sensor slot (uint8), subscriber's sensor index (uint8) and tag (uint16),
+//   subscriber's IP address (4 * uint8), port (uint16), server ID (uint8), lease seconds (uint16; 0 cancels)
+ModbusMessage FC41(ModbusMessage request) {
+  ModbusMessage response;          // returned response message
+  uint8_t slot = 0;
+  uint8_t index = 0;
+  uint16_t tag = 0;
+  uint8_t ip[4];
+  uint16_t port = 0;
+  uint8_t SID = 0;
+  uint16_t lease = 0;
+
+  // Complete request?
+  if (request.size() == 15) {
+    // Yes. Get the data
+    uint16_t offs = request.get(2, slot, index, tag);
+    for (uint8_t i = 0; i < 4; i++) {
+      offs = request.get(offs, ip[i]);
+    }
+    request.get(offs, port, SID, lease);
+    // Only local sensors can be subscribed to
+    if (slot < 2 && settings.sensor[slot].type == DEV_LOCAL && port && SID && SID <= 247) {
+      if (subscribers.subscribe(IPAddress(ip[0], ip[1], ip[2], ip[3]), port, SID, slot, index, tag, lease) >= 0 || lease == 0) {
+        // Confirm with the lease granted and the current sequence number
+        response.add(request.getServerID(), request.getFunctionCode(), slot, index, lease, (slot ? DHT1 : DHT0).pubSeq);
+        LOG_V("Subscription %d.%d.%d.%d:%u:%u for sensor %u, %us\n", ip[0], ip[1], ip[2], ip[3], port, SID, slot, lease);
+      } else {
+        // No room for another subscriber
+        response.setError(request.getServerID(), request.getFunctionCode(), SERVER_DEVICE_BUSY);
+      }
+    } else {
+      response.setError(request.getServerID(), request.getFunctionCode(), ILLEGAL_DATA_VALUE);
+    }
+  } else {
+    response.setError(request.getServerID(), request.getFunctionCode(), ILLEGAL_DATA_VALUE);
+  }
+  return response;
+}
+
+// Modbus server PUBLISH callback: a subscribed Modbus source pushes a fresh reading
+// Request data: our sensor index (uint8) and tag (uint16), sequence number (uint16),
+//   source's measuring interval in seconds (uint16), temperature, humidity and dew point (float)
+ModbusMessage FC42(ModbusMessage request) {
+  ModbusMessage response;          // returned response message
+  uint8_t index = 0;
+  uint16_t tag = 0;
+  uint16_t seq = 0;
+  uint16_t interval = 0;
+  float temperature, humidity, dewPoint;
+
+  // Complete request?
+  if (request.size() == 21) {
+    // Yes. Get the data
+    uint16_t offs = request.get(2, index, tag, seq, interval);
+    request.get(offs, temperature, humidity, dewPoint);
+    // Is it for a sensor that still has this source?
+    if (index < 2 && settings.sensor[index].type == DEV_MODBUS && tag == sourceTag(settings.sensor[index])) {
+      // Yes. Take the values
+      mySensor& ms = index ? DHT1 : DHT0;
+      if (ms.pushInterval && seq != (uint16_t)(ms.pushSeq + 1)) {
+        LOG_W("Sensor %u: %u pushes missed\n", index, (uint16_t)(seq - ms.pushSeq - 1));
+      }
+      ms.pushSeq = seq;
+      ms.pushInterval = interval ? interval : 1;
+      ms.lastPush = millis();
+      ms.th.temperature = temperature;
+      ms.th.humidity = humidity;
+      ms.dewPoint = dewPoint;
+      // Register successful read
+      ms.healthTracker <<= 1;
+      ms.healthTracker |= 1;
+      ms.statusLED.start(DEVICE_OK);
+      ms.lastCheckOK = true;
+      refreshMeasured();
+      response.add(request.getServerID(), request.getFunctionCode(), index, seq);
+    } else {
+      // Unknown subscription - the source will drop it after some failed pushes
+      response.setError(request.getServerID(), request.getFunctionCode(), ILLEGAL_DATA_VALUE);
+    }
+  } else {
+    response.setError(request.getServerID(), request.getFunctionCode(), ILLEGAL_DATA_VALUE);
+  }
+  return response;
+}
+
 // Reboot command
 ModbusMessage FC44(ModbusMessage request) {
   ModbusMessage response;
@@ -1231,6 +1730,92 @@ ModbusMessage FC44(ModbusMessage request) {
   return response;
 }
 
+// FC45tiers: history tiers as binary frames (FC45 version 2)
+ModbusMessage FC45tiers(ModbusMessage request) {
+  ModbusMessage response;
+  uint8_t version = 0;
+  uint8_t tier = HT_END;
+  uint16_t first = 0;
+  uint16_t count = 0;
+
+  request.get(2, version, tier, first, count);
+  HistoryTier *ht = (tier == HT_HOURS) ? &hourlyTier : (tier == HT_DAYS) ? &dailyTier : nullptr;
+  uint16_t size = ht ? ht->size() : HistorySlots;
+  // Is the range valid?
+  if (tier >= HT_END || !count || first >= size) {
+    // No.
+    response.setError(request.getServerID(), request.getFunctionCode(), ILLEGAL_DATA_ADDRESS);
+    return response;
+  }
+  // Yes. Limit the range to the tier and the frame to the PDU size
+  if (count > size - first) {
+    count = size - first;
+  }
+  uint8_t entries = (count > HF_MAXTIERENTRIES) ? HF_MAXTIERENTRIES : count;
+  HistoryEntry buf[HF_MAXTIERENTRIES];
+  HistoryEntry *e = history + first;
+  uint16_t current = calcHistory.calcSlot();
+  if (ht) {
+    // The longer tiers are on flash
+    entries = ht->read(first, entries, buf);
+    e = buf;
+    current = ht->index(ht->periodStart(time(NULL)));
+    if (!entries) {
+      response.setError(request.getServerID(), request.getFunctionCode(), SERVER_DEVICE_FAILURE);
+      return response;
+    }
+  }
+  uint16_t next = (entries < count) ? first + entries : HF_END;
+  response.add(request.getServerID(), request.getFunctionCode(), HF_TIERS, tier, size, current);
+  response.add(first, entries, next);
+  for (uint8_t i = 0; i < entries; i++) {
+    response.add(e[i].stamp, e[i].count, e[i].on);
+    for (uint8_t v = 0; v < HV_COUNT; v++) response.add(e[i].avg[v]);
+    for (uint8_t v = 0; v < HV_COUNT; v++) response.add(e[i].low[v]);
+    for (uint8_t v = 0; v < HV_COUNT; v++) response.add(e[i].high[v]);
+  }
+  return response;
+}
+
+// Modbus server USER_DEFINED_45 callback: history slots as a binary frame
+// Request: version, first slot, number of slots (see RegisterMap.h)
+ModbusMessage FC45(ModbusMessage request) {
+  ModbusMessage response;
+  uint8_t version = 0;
+  uint16_t first = 0;
+  uint16_t count = 0;
+
+  // Get the request parameters, if the size is right
+  if (request.size() == 7) {
+    request.get(2, version, first, count);
+  } else if (request.size() == 8 && request[2] == HF_TIERS) {
+    // The tiers have their own frame format
+    return FC45tiers(request);
+  }
+  // Do we know the frame format? (a malformed request will end up here as well)
+  if (version != HF_VERSION) {
+    // No.
+    response.setError(request.getServerID(), request.getFunctionCode(), ILLEGAL_DATA_VALUE);
+  // Is the range valid?
+  } else if (!count || first >= HistorySlots) {
+    // No.
+    response.setError(request.getServerID(), request.getFunctionCode(), ILLEGAL_DATA_ADDRESS);
+  } else {
+    // Yes. Limit the range to the history and the frame to the PDU size
+    if (count > HistorySlots - first) {
+      count = HistorySlots - first;
+    }
+    uint8_t entries = (count > HF_MAXENTRIES) ? HF_MAXENTRIES : count;
+    uint16_t next = (entries < count) ? first + entries : HF_END;
+    response.add(request.getServerID(), request.getFunctionCode(), HF_VERSION, HistorySlots, calcHistory.calcSlot());
+    response.add(first, entries, next);
+    for (uint16_t i = first; i < first + entries; i++) {
+      response.add(history[i].avg[HV_TEMP0], history[i].avg[HV_HUM0], history[i].avg[HV_TEMP1], history[i].avg[HV_HUM1], history[i].on);
+    }
+  }
+  return response;
+}
+
 // -----------------------------------------------------------------------------
 // Setup WiFi in RUN mode
 // -----------------------------------------------------------------------------
@@ -1250,7 +1835,7 @@ void wifiSetup(const char *hostname) {
 
   // Wait for connection. ==> We will hang here in RUN mode forever without a WiFi!
   while (WiFi.status() != WL_CONNECTED) {
-    signalLED.update();
+    LEDs.update();
     delay(50);
   }
 
@@ -1267,44 +1852,88 @@ void wifiSetup(const char *hostname) {
   signalLED.stop();
 }
 
+// trackRtt: count the round trip time of a request in the statistics of the remote device(s) it went to
+void trackRtt(uint32_t token, Error e) {
+  uint8_t kind = ClientPool::kindOf(token);
+  uint8_t devices = 0;                      // Bit 0: S0, bit 1: S1, bit 2: target
+
+  if (kind == RK_SENSOR || kind == (RK_SENSOR | 1) || kind == RK_SUBSCRIBE || kind == (RK_SUBSCRIBE | 1)) {
+    devices = 1 << (kind & 1);
+  } else if (kind >= RK_SENSORS && kind <= (RK_SENSORS | 3)) {
+    devices = 3;
+  } else if (kind == RK_TARGET_READ || kind == RK_TARGET_WRITE) {
+    devices = 4;
+  }
+  uint32_t elapsed = clients.elapsed(token);
+  for (uint8_t dev = 0; dev < 3; dev++) {
+    if (devices & (1 << dev)) {
+      if (e == TIMEOUT) {
+        rtt[dev].timeout();
+      // Responses and error responses of the device count, connection errors do not
+      } else if (e < TIMEOUT) {
+        rtt[dev].sample(elapsed);
+      }
+      refreshRtt(dev);
+    }
+  }
+}
+
 // Error handler for Modbus client
 void handleError(Error e, uint32_t token) {
   ModbusError me(e);
-  LOG_E("Error response for request %04X: %02X - %s\n", token, e, (const char *)me);
+  uint8_t kind = ClientPool::kindOf(token);
+  LOG_E("Error response for request %08X: %02X - %s\n", token, e, (const char *)me);
   registerMBerror(e);
+  trackRtt(token, e);
   // Register it in the appropriate health tracker
-  if (token == 0x1008) { 
-    DHT0.healthTracker <<= 1; 
-    DHT0.statusLED.start(DEVICE_ERROR_BLINK);
-    DHT0.lastCheckOK = false;
-  } else if ((token & 0xFFFF) == 0x1009) { 
-    DHT1.healthTracker <<= 1; 
-    DHT1.statusLED.start(DEVICE_ERROR_BLINK);
-    DHT1.lastCheckOK = false;
-  } else if ((token & 0xFFFF) == 0x2008 || (token & 0xFFFF) == 0x2009) { 
-    targetHealth <<= 1; 
-    targetLED.start(DEVICE_ERROR_BLINK);
+  if (kind == RK_SENSOR || kind == (RK_SENSOR | 1)) {
+    retrySensor(kind & 1, e);
+  } else if (kind >= RK_SENSORS && kind <= (RK_SENSORS | 3)) {
+    retrySensor(0, e);
+    retrySensor(1, e);
+  } else if (kind == RK_TARGET_READ || kind == RK_TARGET_WRITE) { 
+    // A switch request is worth a retry, the next state poll will come anyway
+    if (kind == RK_TARGET_READ || !scheduleRetry(2, e, MEASURE_DEADLINE)) {
+      remoteGaveUp(2);
+      targetHealth <<= 1; 
+      targetLED.start(DEVICE_ERROR_BLINK);
+    }
+  } else if (kind >= RK_PUSH && kind < RK_PUSH + SUBSCRIBERS_MAX) { // Push to a subscriber
+    subscribers.pushed(kind - RK_PUSH, false);
   }
+  refreshMeasured();
+}
+
+// takeRemote: take a sensor's data from a response, starting at byte offs
+void takeRemote(mySensor& sensor, ModbusMessage& response, uint16_t offs) {
+  offs = response.get(offs, sensor.th.temperature);
+  offs = response.get(offs, sensor.th.humidity);
+  offs = response.get(offs, sensor.dewPoint);
+  // Register successful request
+  sensor.healthTracker <<= 1;
+  sensor.healthTracker |= 1;
+  sensor.statusLED.start(DEVICE_OK);
+  sensor.lastCheckOK = true;
+  remoteOK(sensor.sensor01);
+  measureArrived(sensor);
 }
 
 // Response handler for Modbus client
 void handleData(ModbusMessage response, uint32_t token) {
+  uint8_t kind = ClientPool::kindOf(token);
   // Register successful request
   registerMBerror(SUCCESS);
-  if ((token & 0xFFFF) == 0x1008 || (token & 0xFFFF) == 0x1009) { // Sensor data request
-    // Get sensor slot
-    mySensor& sensor = ((token & 0xFFFF) == 0x1008) ? DHT0 : DHT1;
-    // get data
-    uint16_t offs = 3;
-    offs = response.get(offs, sensor.th.temperature);
-    offs = response.get(offs, sensor.th.humidity);
-    offs = response.get(offs, sensor.dewPoint);
-    // Register successful request
-    sensor.healthTracker <<= 1;
-    sensor.healthTracker |= 1;
-    sensor.statusLED.start(DEVICE_OK);
-    sensor.lastCheckOK = true;
-  } else if ((token & 0xFFFF) == 0x2008) { // target state request
+  trackRtt(token, SUCCESS);
+  if (kind == RK_SENSOR || kind == (RK_SENSOR | 1)) { // Sensor data request
+    takeRemote((kind & 1) ? DHT1 : DHT0, response, 3);
+  } else if (kind >= RK_SENSORS && kind <= (RK_SENSORS | 3)) { // Combined request for both sensors
+    // Find the data of each sensor in the response by the source slots
+    uint16_t a0 = regAddress(RF_VALUE_TEMP, (kind >> 1) & 1);
+    uint16_t a1 = regAddress(RF_VALUE_TEMP, kind & 1);
+    uint16_t start = (a0 < a1) ? a0 : a1;
+    takeRemote(DHT0, response, 3 + (a0 - start) * 2);
+    takeRemote(DHT1, response, 3 + (a1 - start) * 2);
+  } else if (kind == RK_TARGET_READ) { // target state request
     // Get data
     uint16_t stateT = 0;
     response.get(3, stateT);
@@ -1313,7 +1942,8 @@ void handleData(ModbusMessage response, uint32_t token) {
     targetHealth <<= 1;
     targetHealth |= 1;
     targetLED.start(DEVICE_OK);
-  } else if ((token & 0xFFFF) == 0x2009) { // target switch request
+    remoteOK(2);
+  } else if (kind == RK_TARGET_WRITE) { // target switch request
     // Get data
     uint16_t stateT = 0;
     response.get(4, stateT);
@@ -1322,11 +1952,30 @@ void handleData(ModbusMessage response, uint32_t token) {
     targetHealth <<= 1;
     targetHealth |= 1;
     targetLED.start(DEVICE_OK);
+    remoteOK(2);
     registerEvent(switchedON ? TARGET_ON : TARGET_OFF);
+  } else if (kind >= RK_PUSH && kind < RK_PUSH + SUBSCRIBERS_MAX) { // Push to a subscriber
+    subscribers.pushed(kind - RK_PUSH, true);
+  } else if (kind == RK_SUBSCRIBE || kind == (RK_SUBSCRIBE | 1)) { // Subscription
+    LOG_V("Sensor %u subscribed\n", kind & 1);
   } else {
     // Unknown token?
-    LOG_E("Unknown response %04X received.\n", token);
+    LOG_E("Unknown response %08X received.\n", token);
+  }
+  refreshMeasured();
+}
+
+// sendTargetSwitch: send a switch request to a Modbus target
+Error sendTargetSwitch(bool onOff) {
+  targetWanted = onOff;
+  clients.setTimeout(settings.targetIP, settings.targetPort, requestTimeout(2));
+  Error e = clients.addRequest(settings.targetIP, settings.targetPort, RK_TARGET_WRITE, settings.targetSID, WRITE_HOLD_REGISTER, 1, onOff ? 1 : 0);
+  if (e != SUCCESS) {
+    ModbusError me(e);
+    LOG_E("Error sending switch request: %02X - %s\n", e, (const char *)me);
+    registerMBerror(e);
   }
+  return e;
 }
 
 // Change target state to ON or OFF
@@ -1342,20 +1991,47 @@ void switchTarget(bool onOff) {
       registerEvent(onOff ? TARGET_ON : TARGET_OFF);
       switchedON = onOff;
     } else if (settings.Target == DEV_MODBUS) {
-      MBclient.setTarget(settings.targetIP, settings.targetPort);
-      Error e = MBclient.addRequest((uint32_t)((millis() << 16) | 0x2009), settings.targetSID, WRITE_HOLD_REGISTER, 1, onOff ? 1 : 0);
-      if (e != SUCCESS) {
-        ModbusError me(e);
-        LOG_E("Error sending 0x2009 request: %02X - %s\n", e, (const char *)me);
-        registerMBerror(e);
-      }
+      // A new request makes pending retries obsolete
+      policy[2].retryPending = false;
+      policy[2].retries = 0;
+      sendTargetSwitch(onOff);
       LOG_V("Switch request sent\n");
     }
+    refreshMeasured();
   }
   // Update signal LED anyway
   signalLED.start(onOff ? TARGET_ON_BLINK : TARGET_OFF_BLINK);
 }
 
+// retryTask: send the retries that are due
+void retryTask() {
+  uint32_t next = 0xFFFFFFFF;
+  for (uint8_t dev = 0; dev < 3; dev++) {
+    RemotePolicy& p = policy[dev];
+    if (!p.retryPending) continue;
+    int32_t due = p.retryAt - millis();
+    // Is it due?
+    if (due <= 0) {
+      // Yes. Send it again
+      p.retryPending = false;
+      if (dev < 2) {
+        if (sendSensorPoll(dev) != SUCCESS) {
+          remoteFailed(dev ? DHT1 : DHT0);
+          refreshMeasured();
+        }
+      } else {
+        sendTargetSwitch(targetWanted);
+      }
+    } else if ((uint32_t)due < next) {
+      next = due;
+    }
+  }
+  // Any more waiting?
+  if (next != 0xFFFFFFFF) {
+    tasks.reschedule(retryTaskID, next);
+  }
+}
+
 // Web server callbacks
 // Illegal page requested
 void notFound() {
@@ -1377,6 +2053,7 @@ void notFound() {
 // Restart device
 void handleRestart() {
   HTMLserver.client().stop();
+  saveHistory();
   ESP.restart();
 }
 
@@ -1393,6 +2070,13 @@ void handleDevice() {
       message += AP_SSID;
     }
     message += " status</title></header><body>\n";
+    // Report config input that was not taken
+    if (configNote.length()) {
+      message += "<p style=\"color: red;\">";
+      message += configNote;
+      message += "</p>\n";
+      configNote = "";
+    }
     // Add in deviceinfo
     message += deviceInfo;
     message += "<button onclick=\"window.location.href='/config.html';\" class=\"button\"> CONFIG page </button><div class=\"divider\"/>";
@@ -1641,6 +2325,21 @@ void handleSet() {
         if ((uintval == 0) && settings.fallbackSwitch) { settings.fallbackSwitch = false; needsWrite = true; }
         if ((uintval != 0) && !settings.fallbackSwitch) { settings.fallbackSwitch = true; needsWrite = true; }
         break;
+      case 49: // History slots - will be effective with the next start
+        if (uintval != settings.historySlots) {
+          // Same checks as for a Modbus write
+          if (historyFits(uintval)) {
+            settings.historySlots = uintval;
+            needsWrite = true;
+          } else {
+            configNote += "History slots ";
+            configNote += uintval;
+            configNote += " not possible, kept ";
+            configNote += settings.historySlots;
+            configNote += ".<br>";
+          }
+        }
+        break;
       default: // Unhandled number
         LOG_I("CV parameter number unhandled [0..%d]: %d\n", CONFIGPARAMS, numbr);
         break;
@@ -1656,10 +2355,274 @@ void handleSet() {
   handleDevice();
 }
 
+// -----------------------------------------------------------------------------
+// Scheduled tasks in RUN mode
+// -----------------------------------------------------------------------------
+const uint32_t TICK_INTERVAL(60000);        // Runtime counter, date and target poll interval
+const uint32_t HOUSEKEEPING_INTERVAL(500);  // Reboot handling interval
+
+// evaluateTask: check switching conditions and collect history for the readings of a measurement cycle
+void evaluateTask() {
+  tasks.stop(evaluateTaskID);
+  // Are readings missing?
+  if (measurePending) {
+    // Yes. Those sensors are taken with their previous data
+    LOG_W("Readings missing (%u), using previous data\n", measurePending);
+    measurePending = 0;
+  }
+  //  Check switch conditions
+  s1cond = 0;
+  s2cond = 0;
+  cccond = 0;
+  // Kill oldest hysteresis bit
+  Hysteresis <<= 1;
+  // Check for valid measurements
+  uint8_t measurementSuccess = 0;
+
+  // Check both sensors
+  for (uint8_t i = 0; i < 2; i++) {
+    // Select sensor
+    mySensor& sensor = (i == 0) ? DHT0 : DHT1;
+    uint8_t& checks = (i == 0 ? s1cond : s2cond);
+    // Keep in mind if the sensor is relevant at all
+    sensor.isRelevant = (settings.sensor[i].TempMode != DEVC_NONE
+          || settings.sensor[i].HumMode != DEVC_NONE
+          || settings.sensor[i].DewMode != DEVC_NONE
+          || settings.TempDiff != DEVC_NONE
+          || settings.HumDiff != DEVC_NONE
+          || settings.DewDiff != DEVC_NONE);
+
+    // Do we need a measurement at all?
+    if (settings.sensor[i].type != DEV_NONE) {
+      // We do, check the reading.
+      if (sensor.lastCheckOK) {
+        measurementSuccess++;
+      }
+      // Is it relevant?
+      if (sensor.isRelevant) {
+        // Yes. Did we get data? (measurementSuccess will have been incremented already)
+        if (sensor.lastCheckOK) {
+          // Yes, we did.
+          // 1: Check temperature
+          switch (settings.sensor[i].TempMode) {
+          case DEVC_NONE:  checks++; break;
+          case DEVC_LESS:  if (sensor.th.temperature < settings.sensor[i].Temp) { checks++; } break;
+          case DEVC_GREATER:  if (sensor.th.temperature > settings.sensor[i].Temp) { checks++; } break;
+          case DEVC_RESERVED: break;
+          }
+          // 2: Check humidity
+          switch (settings.sensor[i].HumMode) {
+          case DEVC_NONE:  checks++; break;
+          case DEVC_LESS:  if (sensor.th.humidity < settings.sensor[i].Hum) { checks++; } break;
+          case DEVC_GREATER:  if (sensor.th.humidity > settings.sensor[i].Hum) { checks++; } break;
+          case DEVC_RESERVED: break;
+          }
+          // 3: Check dew point
+          switch (settings.sensor[i].DewMode) {
+          case DEVC_NONE:  checks++; break;
+          case DEVC_LESS:  if (sensor.dewPoint < settings.sensor[i].Dew) { checks++; } break;
+          case DEVC_GREATER:  if (sensor.dewPoint > settings.sensor[i].Dew) { checks++; } break;
+          case DEVC_RESERVED: break;
+          }
+        } else {
+          // No, measurement has failed. Bail out here
+          break;
+        }
+      } else {
+        // It is irrelevant, so assume all conditions met
+        checks = 3;
+        // Additionally, no combo conditions will have to be met
+        cccond = 3;
+      }
+    } else {
+      // Sensor non-existent, assume all conditions met
+      checks = 3;
+      // Additionally, no combo conditions will have to be met
+      cccond = 3;
+      // Just in case clear previous LED signals
+      sensor.statusLED.stop();
+    }
+  }
+
+  // Finally check combo conditions
+  // If we have one sensor only, no need to check
+  if (cccond == 0) {
+    // We have both sensors.
+    // Did both measurements (if any) succeed?
+    if (measurementSuccess == 2) {
+      // Reset failure counter
+      failCnt = 0;
+      // Check temperature
+      switch (settings.TempDiff) {
+      case DEVC_NONE: cccond++; break;
+      case DEVC_LESS: if (DHT0.th.temperature - DHT1.th.temperature < settings.Temp) { cccond++; } break;
+      case DEVC_GREATER: if (DHT0.th.temperature - DHT1.th.temperature > settings.Temp) { cccond++; } break;
+      case DEVC_RESERVED: break;
+      }
+      // Check humidity
+      switch (settings.HumDiff) {
+      case DEVC_NONE: cccond++; break;
+      case DEVC_LESS: if (DHT0.th.humidity - DHT1.th.humidity < settings.Hum) { cccond++; } break;
+      case DEVC_GREATER: if (DHT0.th.humidity - DHT1.th.humidity > settings.Hum) { cccond++; } break;
+      case DEVC_RESERVED: break;
+      }
+      // Check dew point
+      switch (settings.DewDiff) {
+      case DEVC_NONE: cccond++; break;
+      case DEVC_LESS: if (DHT0.dewPoint - DHT1.dewPoint < settings.Dew) { cccond++; } break;
+      case DEVC_GREATER: if (DHT0.dewPoint - DHT1.dewPoint > settings.Dew) { cccond++; } break;
+      case DEVC_RESERVED: break;
+      }
+    } else {
+      // We failed for at least one sensor!
+      failCnt++;
+      if (failCnt > 3) {
+        // Three failures in a row - fallback!
+        switchTarget(settings.fallbackSwitch);
+        registerEvent(FAIL_FB);
+      }
+    }
+  }
+
+  // Consider switching only if not in fail state
+  if (failCnt == 0) {
+    // All conditions met?
+    if (s1cond + s2cond + cccond == 9) {
+      Hysteresis |= 1;
+    }
+    // Store conditions for Modbus retrieval
+    cState = (s1cond << 8) | (s2cond << 4) | cccond;
+
+    // Shall we be active?
+    if (settings.masterSwitch) {
+      // Yes, Determine resulting switch state
+      bool desiredStateON = false;
+      // Did all considered measurements suggest ON state?
+      if ((Hysteresis & HYSTERESIS_MASK) == HYSTERESIS_MASK) {
+        // Yes, note it.
+        desiredStateON = true;
+      }
+      // Switch target (if necessary)
+      switchTarget(desiredStateON);
+    }
+  }
+
+  // Collect data in history
+  calcHistory.collect(DHT0.th.temperature, DHT0.th.humidity, DHT1.th.temperature, DHT1.th.humidity, switchedON);
+    
+  // Debug output
+  LOG_V("S0 %5.1f %5.1f %5.1f %s\n", DHT0.th.temperature, DHT0.th.humidity, DHT0.dewPoint, DHT0.lastCheckOK ? "OK" : "FAIL");
+  LOG_V("S1 %5.1f %5.1f %5.1f %s\n", DHT1.th.temperature, DHT1.th.humidity, DHT1.dewPoint, DHT1.lastCheckOK ? "OK" : "FAIL");
+  LOG_V("    Check=%d/%d/%d Fails=%d Hysteresis=%04X\n", s1cond, s2cond, cccond, failCnt, Hysteresis);
+  // The cycle is complete
+  measureSeq++;
+  refreshMeasured();
+}
+
+// measureTask: start a measurement cycle
+// Local reads and Modbus polls are asynchronous, so the conditions are checked by evaluateTask()
+// when all readings have arrived or MEASURE_DEADLINE has passed.
+void measureTask() {
+  // Is the previous cycle still waiting for readings?
+  if (tasks.isActive(evaluateTaskID)) {
+    // Yes. Evaluate it with what we have
+    evaluateTask();
+  }
+  // Request the data of all sensors with a Modbus source in one go
+  cycleStart = millis();
+  measurePending = pollRemoteSensors();
+  // Start the reads of the physical sensors
+  for (uint8_t i = 0; i < 2; i++) {
+    if (takeMeasurement(i ? DHT1 : DHT0)) {
+      measurePending |= (1 << i);
+    }
+  }
+  // Wait for the readings, if any are expected
+  tasks.reschedule(evaluateTaskID, measurePending ? MEASURE_DEADLINE : 0);
+}
+
+// tickTask: advance the runtime counter
+void tickTask() {
+  // Increment it as long as it did not hit the ceiling yet
+  if (runTime < 65535) {
+    runTime++;
+  }
+  // The current history slot may have changed as well
+  refreshCounters();
+  // Debug output
+  LOG_V("Health tracker: S1=%04X S2=%04X Tg=%04X\n", DHT0.healthTracker, DHT1.healthTracker, targetHealth);
+}
+
+// dateTask: check for a date change
+void dateTask() {
+  time_t now = time(NULL);
+  tm tm;
+  localtime_r(&now, &tm);           // update the structure tm with the current time
+  if (tm.tm_hour == 0 && tm.tm_min == 0) {
+    registerEvent(DATE_CHANGE);
+  }
+}
+
+// pollTask: get the target switch state
+void pollTask() {
+  // Is a target configured?
+  if (settings.Target != DEV_NONE) {
+    // Yes. get switch state
+    // Is it a Modbus device?
+    if (settings.Target == DEV_MODBUS) {
+      // Yes. Is it down?
+      if (remoteDown(2)) {
+        // Yes, leave it alone for now
+        LOG_V("Target down, not polled\n");
+        return;
+      }
+      // No, send a request
+      clients.setTimeout(settings.targetIP, settings.targetPort, requestTimeout(2));
+      Error e = clients.addRequest(settings.targetIP, settings.targetPort, RK_TARGET_READ, settings.targetSID, READ_HOLD_REGISTER, 1, 1);
+      if (e != SUCCESS) {
+        ModbusError me(e);
+        Serial.printf("Error sending switch state request: %02X - %s\n", e, (const char *)me);
+        registerMBerror(e);
+      }
+      LOG_V("Switch status requested\n");
+    } else {
+      // No, shall be local
+      // We must trust on the wiring, so we assume good health
+      switchedON = digitalRead(TARGET_PIN);
+      targetHealth <<= 1;
+      targetHealth |= 1;
+      // Toggle LED to show target switch state
+      targetLED.start(switchedON ? DEVICE_OK : DEVICE_IGNORED);
+      refreshMeasured();
+    }
+  }
+}
+
+// housekeepingTask: take care of reboot requests
+void housekeepingTask() {
+  // Reboot requested?
+  if (rebootPending == 2) {
+    // Yes. Save pending settings changes and history slots, then restart now
+    commitTask();
+    saveHistory();
+    ESP.restart();
+  } else if (rebootGrace && millis() - rebootGrace > 60000) {
+    // No, but the grace period has passed. Deactivate reboot sequence
+    rebootPending = 0;
+    rebootGrace = 0;
+  }
+}
+
 void setup() {
   // Activate logging, if required
   MBUlogLvl = LOCAL_LOG_LEVEL;
 
+  // Put all LEDs under control of the LED engine
+  LEDs.add(signalLED);
+  LEDs.add(S0LED);
+  LEDs.add(S1LED);
+  LEDs.add(targetLED);
+
   // Assume target not active
   signalLED.start(TARGET_OFF_BLINK);
 
@@ -1677,8 +2640,8 @@ void setup() {
   digitalWrite(TARGET_PIN, LOW);
 
   // (Try to) init sensors
-  DHT0.sensor.setup(SENSOR_0, DHTesp::DHT22);
-  DHT1.sensor.setup(SENSOR_1, DHTesp::DHT22);
+  DHT0.sensor.setup(SENSOR_0, sensorRead, &DHT0);
+  DHT1.sensor.setup(SENSOR_1, sensorRead, &DHT1);
 
   // First check of sensors
   checkSensor(DHT0);
@@ -1686,6 +2649,8 @@ void setup() {
 
   // Make time for held button detection longer - 1s
   tSwitch.setTiming(250, 1000);
+  // Have the button watched by an edge interrupt instead of polling it
+  tSwitch.enableInterrupt();
 
   // Start file system handling
   LittleFS.begin();
@@ -1722,6 +2687,17 @@ void setup() {
     LOG_E("Settings file '" RESTARTS "' does not exist.");
   }
 
+  // Settings of the previous layout are valid, but have undefined history slots in the padding
+  if (settings.magicValue == MAGICVALUE_NOSLOTS) {
+    LOG_I("Migrating settings to add the history slots\n");
+    settings.magicValue = MAGICVALUE;
+    settings.historySlots = HISTORY_DEFAULT;
+    int rc = writeSettings();
+    if (rc != 0) {
+      LOG_E("Writing migrated settings failed (%d)\n", rc);
+    }
+  }
+
   // Check if it is a valid settings file
   if (settings.magicValue == MAGICVALUE) {
     // It is - adjust runtime data with values from EEPROM
@@ -1745,6 +2721,7 @@ void setup() {
     restarts = 0;
     settings.masterSwitch = false;
     settings.fallbackSwitch = false;
+    settings.historySlots = HISTORY_DEFAULT;
     settings.hystSteps = 4;
     settings.measuringInterval = 20;
     settings.targetPort = 502;
@@ -1782,7 +2759,9 @@ void setup() {
   uint32_t t0 = millis();
 
   while (millis() - t0 <= 3000) {
-    signalLED.update();
+    LEDs.update();
+    DHT0.sensor.update();
+    DHT1.sensor.update();
     if (tSwitch.update() > 0) {
       // Button pressed?
       if (tSwitch.getEvent() != BE_NONE) {
@@ -1808,6 +2787,19 @@ void setup() {
     // Start NTP
     configTime(MY_TZ, MY_NTP_SERVER); 
 
+    // Allocate the history. The stored size may be invalid or may not fit anymore
+    if (!historyFits(settings.historySlots)) {
+      LOG_W("History slots %u not possible, using %u\n", settings.historySlots, HISTORY_DEFAULT);
+      settings.historySlots = HISTORY_DEFAULT;
+    }
+    resizeHistory(settings.historySlots);
+    // Get back the history saved before the last restart. The time zone must be known to find the slots.
+    uint16_t restored = historyLog.load(restoreHistory);
+    LOG_I("%u history slots restored\n", restored);
+    if (!hourlyTier.begin() || !dailyTier.begin()) {
+      LOG_E("Could not set up the history tier files\n");
+    }
+
     // Register boot event
     registerEvent(BOOT_DATE);
     registerEvent(BOOT_TIME);
@@ -1815,6 +2807,7 @@ void setup() {
     // Start up OTA server
     ArduinoOTA.setHostname(settings.deviceName);  // Set OTA host name
     ArduinoOTA.setPassword((const char *)settings.OTAPass);  // Set OTA password
+    ArduinoOTA.onStart(saveHistory);  // Save history before the update
     ArduinoOTA.begin();               // start OTA scan
 
     // Calculate hysteresis mask
@@ -1832,23 +2825,51 @@ void setup() {
     // Register state of Master switch
     registerEvent(settings.masterSwitch ? MASTER_ON : MASTER_OFF);
     // Shorten idle timeout for Modbus client connections
-    MBclient.setTimeout(10000);
-    // Register response handlers
-    MBclient.onErrorHandler(handleError);
-    MBclient.onDataHandler(handleData);
+    // Set up the Modbus clients and register response handlers
+    clients.begin(handleData, handleError, CLIENT_TIMEOUT, CLIENT_IDLE);
 
     // Register Modbus server functions
     MBserver.registerWorker(MYSID, READ_HOLD_REGISTER, FC03);
+    MBserver.registerWorker(MYSID, READ_INPUT_REGISTER, FC04);
     MBserver.registerWorker(MYSID, WRITE_HOLD_REGISTER, FC06);
     MBserver.registerWorker(MYSID, WRITE_MULT_REGISTERS, FC10);
     // Special restart worker
     MBserver.registerWorker(MYSID, USER_DEFINED_44, FC44);
+    // Bulk history transfer
+    MBserver.registerWorker(MYSID, USER_DEFINED_45, FC45);
+    // Sensor data subscriptions
+    MBserver.registerWorker(MYSID, USER_DEFINED_41, FC41);
+    MBserver.registerWorker(MYSID, USER_DEFINED_42, FC42);
 
     // Create device info string
     writeDeviceInfo();
 
-    // Start Modbus server
-    MBserver.start(502, 4, 2000);
+    // Fill the Modbus register image
+    refreshImage();
+
+    // Start Modbus server. Other devices' clients keep their connections open as well,
+    // so we will allow a few more of them and do not close idle ones too early.
+    MBserver.start(MYPORT, 6, CLIENT_IDLE);
+
+    // Schedule the periodic tasks
+    tasks.add(measureTask, INTERVAL_DHT, INTERVAL_DHT);
+    tasks.add(tickTask, TICK_INTERVAL, TICK_INTERVAL);
+    tasks.add(dateTask, TICK_INTERVAL, TICK_INTERVAL);
+    tasks.add(pollTask, TICK_INTERVAL, TICK_INTERVAL);
+    // Reboot requests and settings commits are served in MANUAL mode as well
+    services.add(housekeepingTask, HOUSEKEEPING_INTERVAL, HOUSEKEEPING_INTERVAL);
+    // Settings commit is a one-shot task, started by scheduleCommit()
+    commitTaskID = services.add(commitTask, 0, COMMIT_QUIET);
+    services.stop(commitTaskID);
+    // Pushes waiting for a free client are sent by a one-shot task as well
+    pushTaskID = tasks.add(pushTask, 0, PUSH_RETRY);
+    tasks.stop(pushTaskID);
+    // The conditions of a measurement cycle are checked by a one-shot task, started by measureTask()
+    evaluateTaskID = tasks.add(evaluateTask, 0, MEASURE_DEADLINE);
+    tasks.stop(evaluateTaskID);
+    // Retries of failed requests to remote devices are sent by another one
+    retryTaskID = tasks.add(retryTask, 0, RETRY_DELAY);
+    tasks.stop(retryTaskID);
 
     signalLED.start(TARGET_OFF_BLINK);
   } else {
@@ -1875,22 +2896,10 @@ void setup() {
 }
 
 void loop() {
-  // Timer for measurement cycle
-  static uint32_t measure = millis();  
-  // Timer for runtime counting
-  static uint32_t tick = millis();
-  // Results of last conditions check
-  static uint8_t s1cond = 0;
-  static uint8_t s2cond = 0;
-  static uint8_t cccond = 0;
-  // Counter for measurement failures
-  static uint16_t failCnt = 0;
-
-  // Keep track of blinking status LEDs and button presses
-  signalLED.update();
-  targetLED.update();
-  S0LED.update();
-  S1LED.update();
+  // Keep track of blinking status LEDs and sensor reads
+  LEDs.update();
+  DHT0.sensor.update();
+  DHT1.sensor.update();
 
   // Update mDNS
   MDNS.update();
@@ -1932,211 +2941,13 @@ void loop() {
       }
     }
   
-    // Is it time to advance the runtime counter?
-    // (do a target state check as well)
-    if (millis() - tick >= 60000) {
-      // Yes, increment it as long as it did not hit the ceiling yet
-      if (runTime < 65535) {
-        runTime++;
-      }
-      // Check for data change
-      time_t now = time(NULL);
-      tm tm;
-      localtime_r(&now, &tm);           // update the structure tm with the current time
-      if (tm.tm_hour == 0 && tm.tm_min == 0) {
-        registerEvent(DATE_CHANGE);
-      }
-      // Is a target configured?
-      if (settings.Target != DEV_NONE) {
-        // Yes. get switch state
-        // Is it a Modbus device?
-        if (settings.Target == DEV_MODBUS) {
-          // Yes, send a request
-          MBclient.setTarget(settings.targetIP, settings.targetPort);
-          Error e = MBclient.addRequest((uint32_t)((millis() << 16) | 0x2008), settings.targetSID, READ_HOLD_REGISTER, 1, 1);
-          if (e != SUCCESS) {
-            ModbusError me(e);
-            Serial.printf("Error sending request 0x2008: %02X - %s\n", e, (const char *)me);
-            registerMBerror(e);
-          }
-          LOG_V("Switch status requested\n");
-        } else {
-          // No, shall be local
-          // We must trust on the wiring, so we assume good health
-          switchedON = digitalRead(TARGET_PIN);
-          targetHealth <<= 1;
-          targetHealth |= 1;
-          // Toggle LED to show target switch state
-          targetLED.start(switchedON ? DEVICE_OK : DEVICE_IGNORED);
-        }
-      }
-      // Debug output
-      LOG_V("Health tracker: S1=%04X S2=%04X Tg=%04X\n", DHT0.healthTracker, DHT1.healthTracker, targetHealth);
-      // Reset timer
-      tick = millis();
-    }
-
-    // Is it time to do another measurement?
-    if (millis() - measure > INTERVAL_DHT) {
-      //  Check switch conditions
-      s1cond = 0;
-      s2cond = 0;
-      cccond = 0;
-      // Kill oldest hysteresis bit
-      Hysteresis <<= 1;
-      // Check for valid measurements
-      uint8_t measurementSuccess = 0;
-
-      // Check both sensors
-      for (uint8_t i = 0; i < 2; i++) {
-        // Select sensor
-        mySensor& sensor = (i == 0) ? DHT0 : DHT1;
-        uint8_t& checks = (i == 0 ? s1cond : s2cond);
-        // Keep in mind if the sensor is relevant at all
-        sensor.isRelevant = (settings.sensor[i].TempMode != DEVC_NONE
-              || settings.sensor[i].HumMode != DEVC_NONE
-              || settings.sensor[i].DewMode != DEVC_NONE
-              || settings.TempDiff != DEVC_NONE
-              || settings.HumDiff != DEVC_NONE
-              || settings.DewDiff != DEVC_NONE);
-
-        // Do we need a measurement at all?
-        if (settings.sensor[i].type != DEV_NONE) {
-          // We do, check sensor.
-          takeMeasurement(sensor);
-          if (sensor.lastCheckOK) {
-            measurementSuccess++;
-          }
-          // Is it relevant?
-          if (sensor.isRelevant) {
-            // Yes. Did we get data? (measurementSuccess will have been incremented already)
-            if (sensor.lastCheckOK) {
-              // Yes, we did.
-              // 1: Check temperature
-              switch (settings.sensor[i].TempMode) {
-              case DEVC_NONE:  checks++; break;
-              case DEVC_LESS:  if (sensor.th.temperature < settings.sensor[i].Temp) { checks++; } break;
-              case DEVC_GREATER:  if (sensor.th.temperature > settings.sensor[i].Temp) { checks++; } break;
-              case DEVC_RESERVED: break;
-              }
-              // 2: Check humidity
-              switch (settings.sensor[i].HumMode) {
-              case DEVC_NONE:  checks++; break;
-              case DEVC_LESS:  if (sensor.th.humidity < settings.sensor[i].Hum) { checks++; } break;
-              case DEVC_GREATER:  if (sensor.th.humidity > settings.sensor[i].Hum) { checks++; } break;
-              case DEVC_RESERVED: break;
-              }
-              // 3: Check dew point
-              switch (settings.sensor[i].DewMode) {
-              case DEVC_NONE:  checks++; break;
-              case DEVC_LESS:  if (sensor.dewPoint < settings.sensor[i].Dew) { checks++; } break;
-              case DEVC_GREATER:  if (sensor.dewPoint > settings.sensor[i].Dew) { checks++; } break;
-              case DEVC_RESERVED: break;
-              }
-            } else {
-              // No, measurement has failed. Bail out here
-              break;
-            }
-          } else {
-            // It is irrelevant, so assume all conditions met
-            checks = 3;
-            // Additionally, no combo conditions will have to be met
-            cccond = 3;
-          }
-        } else {
-          // Sensor non-existent, assume all conditions met
-          checks = 3;
-          // Additionally, no combo conditions will have to be met
-          cccond = 3;
-          // Just in case clear previous LED signals
-          sensor.statusLED.stop();
-        }
-      }
-
-      // Finally check combo conditions
-      // If we have one sensor only, no need to check
-      if (cccond == 0) {
-        // We have both sensors.
-        // Did both measurements (if any) succeed?
-        if (measurementSuccess == 2) {
-          // Reset failure counter
-          failCnt = 0;
-          // Check temperature
-          switch (settings.TempDiff) {
-          case DEVC_NONE: cccond++; break;
-          case DEVC_LESS: if (DHT0.th.temperature - DHT1.th.temperature < settings.Temp) { cccond++; } break;
-          case DEVC_GREATER: if (DHT0.th.temperature - DHT1.th.temperature > settings.Temp) { cccond++; } break;
-          case DEVC_RESERVED: break;
-          }
-          // Check humidity
-          switch (settings.HumDiff) {
-          case DEVC_NONE: cccond++; break;
-          case DEVC_LESS: if (DHT0.th.humidity - DHT1.th.humidity < settings.Hum) { cccond++; } break;
-          case DEVC_GREATER: if (DHT0.th.humidity - DHT1.th.humidity > settings.Hum) { cccond++; } break;
-          case DEVC_RESERVED: break;
-          }
-          // Check dew point
-          switch (settings.DewDiff) {
-          case DEVC_NONE: cccond++; break;
-          case DEVC_LESS: if (DHT0.dewPoint - DHT1.dewPoint < settings.Dew) { cccond++; } break;
-          case DEVC_GREATER: if (DHT0.dewPoint - DHT1.dewPoint > settings.Dew) { cccond++; } break;
-          case DEVC_RESERVED: break;
-          }
-        } else {
-          // We failed for at least one sensor!
-          failCnt++;
-          if (failCnt > 3) {
-            // Three failures in a row - fallback!
-            switchTarget(settings.fallbackSwitch);
-            registerEvent(FAIL_FB);
-          }
-        }
-      }
-
-      // Consider switching only if not in fail state
-      if (failCnt == 0) {
-        // All conditions met?
-        if (s1cond + s2cond + cccond == 9) {
-          Hysteresis |= 1;
-        }
-        // Store conditions for Modbus retrieval
-        cState = (s1cond << 8) | (s2cond << 4) | cccond;
-
-        // Shall we be active?
-        if (settings.masterSwitch) {
-          // Yes, Determine resulting switch state
-          bool desiredStateON = false;
-          // Did all considered measurements suggest ON state?
-          if ((Hysteresis & HYSTERESIS_MASK) == HYSTERESIS_MASK) {
-            // Yes, note it.
-            desiredStateON = true;
-          }
-          // Switch target (if necessary)
-          switchTarget(desiredStateON);
-        }
-      }
-
-      // Collect data in history
-      calcHistory.collect(DHT0.th.temperature, DHT0.th.humidity, DHT1.th.temperature, DHT1.th.humidity, switchedON);
-        
-      // Debug output
-      LOG_V("S0 %5.1f %5.1f %5.1f %s\n", DHT0.th.temperature, DHT0.th.humidity, DHT0.dewPoint, DHT0.lastCheckOK ? "OK" : "FAIL");
-      LOG_V("S1 %5.1f %5.1f %5.1f %s\n", DHT1.th.temperature, DHT1.th.humidity, DHT1.dewPoint, DHT1.lastCheckOK ? "OK" : "FAIL");
-      LOG_V("    Check=%d/%d/%d Fails=%d Hysteresis=%04X\n", s1cond, s2cond, cccond, failCnt, Hysteresis);
-      measure = millis();
-    }
-  
-    // Reboot requested?
-    if (rebootPending == 2) {
-      // Yes. Restart now
-      ESP.restart();
-    } else if (rebootGrace && millis() - rebootGrace > 60000) {
-      // No, but the grace period has passed. Deactivate reboot sequence
-      rebootPending = 0;
-      rebootGrace = 0;
-    }
+    // Run all tasks that are due
+    tasks.run();
+    services.run();
   } else if (mode == MANUAL) {
-    // We are in manual mode.
+    // We are in manual mode. Modbus writes and reboot requests still need to be served
+    services.run();
+
     // Button pressed?
     if (tSwitch.update() > 0) {
       // Yes, get it